@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string>
+#include <vector>
+#include <irc/ircMaskSet.h>
+#include <util/threadHelper.h>
+
+//ircMaskBench.cpp
+//Author: Simon Wittenberg
+
+// Measures how fast IrcMaskSet matches users against BENCH_MASKS masks, like a ban list
+// merged from a large network. Most masks ban a host or a domain, some an address range
+// or a nick, BENCH_GENERIC have nothing to index by. For comparison a list of the same
+// masks is matched one by one, the way examples/censor.cpp checks its ignore list, on a
+// fraction of the users since it is far slower. Adding and removing is timed as well.
+
+#define BENCH_MASKS 100000
+#define BENCH_GENERIC 50
+#define BENCH_LOOKUPS 1000000
+// the list only gets one lookup of this many, odd so it sees every kind of user
+#define BENCH_LIST_FRACTION 997
+
+
+static void benchMask(unsigned int i, char* mask)
+{
+    if(i < BENCH_GENERIC)
+        sprintf(mask, "*!*spam%u*@*", i);
+    else if(i % 10 < 4)
+        sprintf(mask, "*!*@host-%u.dsl.provider%u.example.net", i, i % 17);
+    else if(i % 10 < 7)
+        sprintf(mask, "*!*@*.customer%u.example.org", i);
+    else if(i % 10 < 8)
+        sprintf(mask, "*!*@10.%u.%u.*", (i / 256) % 256, i % 256);
+    else
+        sprintf(mask, "troll%u!*@*", i);
+}
+
+static void benchUser(unsigned int i, char* prefix)
+{
+    // every fourth user is banned one way or another
+    unsigned int n = (i * 7919u) % BENCH_MASKS;
+    if(i % 4)
+        sprintf(prefix, "user%u!~ident%u@host-%u-%u.dsl.provider%u.example.net", i, i % 50, i % 251, i, i % 17);
+    else if(n % 10 < 4)
+        sprintf(prefix, "user%u!~ident@host-%u.dsl.provider%u.example.net", i, n, n % 17);
+    else if(n % 10 < 7)
+        sprintf(prefix, "user%u!~ident@pc%u.customer%u.example.org", i, i % 100, n);
+    else if(n % 10 < 8)
+        sprintf(prefix, "user%u!~ident@10.%u.%u.%u", i, (n / 256) % 256, n % 256, i % 256);
+    else
+        sprintf(prefix, "TROLL%u!~ident@somewhere.example.com", n);
+}
+
+static bool benchGlob(const char* pattern, const char* text)
+{
+    const char* star = NULL;
+    const char* mark = NULL;
+    while(*text)
+    {
+        if(*pattern == '*')
+        {
+            star = pattern++;
+            mark = text;
+        }
+        else if(*pattern == '?' || (*pattern && tolower(*pattern) == tolower(*text)))
+        {
+            pattern++;
+            text++;
+        }
+        else if(star)
+        {
+            pattern = star + 1;
+            text = ++mark;
+        }
+        else
+            return false;
+    }
+    while(*pattern == '*')
+        pattern++;
+    return !*pattern;
+}
+
+static double benchSeconds(millis_t start, millis_t end)
+{
+    double seconds = (end - start) / 1000.0;
+    return seconds > 0 ? seconds : 0.001;
+}
+
+int main(int argc, char** argv)
+{
+    char mask[96], prefix[160];
+    printf("%u masks, %u of them without an index\n", BENCH_MASKS, BENCH_GENERIC);
+
+    millis_t start = getMilliseconds();
+    IrcMaskSet set;
+    std::vector<std::string> list;
+    for(unsigned int i = 0; i < BENCH_MASKS; i++)
+    {
+        benchMask(i, mask);
+        set.add(IrcStringView(mask));
+        list.push_back(mask);
+    }
+    millis_t filled = getMilliseconds();
+
+    unsigned int found = 0;
+    for(unsigned int i = 0; i < BENCH_LOOKUPS; i++)
+    {
+        benchUser(i, prefix);
+        if(set.matches(IrcStringView(prefix)))
+            found++;
+    }
+    millis_t looked = getMilliseconds();
+    printf("%-12s filled in %.3f s, %.0f lookups/s (%u of %u banned)\n", "IrcMaskSet",
+        benchSeconds(start, filled), BENCH_LOOKUPS / benchSeconds(filled, looked), found, BENCH_LOOKUPS);
+
+    // a tenth of the masks goes and comes back, as bans expire and are set again
+    millis_t churn = getMilliseconds();
+    for(unsigned int i = 0; i < BENCH_MASKS; i += 10)
+    {
+        benchMask(i, mask);
+        set.remove(IrcStringView(mask));
+    }
+    for(unsigned int i = 0; i < BENCH_MASKS; i += 10)
+    {
+        benchMask(i, mask);
+        set.add(IrcStringView(mask));
+    }
+    millis_t churned = getMilliseconds();
+    printf("%-12s %.0f removes and adds/s, %u masks\n", "",
+        2 * (BENCH_MASKS / 10) / benchSeconds(churn, churned), (unsigned int)set.size());
+
+    unsigned int listFound = 0;
+    unsigned int listLookups = 0;
+    millis_t listStart = getMilliseconds();
+    for(unsigned int i = 0; i < BENCH_LOOKUPS; i += BENCH_LIST_FRACTION)
+    {
+        benchUser(i, prefix);
+        for(size_t m = 0; m < list.size(); m++)
+        {
+            if(benchGlob(list[m].c_str(), prefix))
+            {
+                listFound++;
+                break;
+            }
+        }
+        listLookups++;
+    }
+    millis_t listEnd = getMilliseconds();
+    printf("%-12s %.0f lookups/s (%u of %u banned)\n", "list",
+        listLookups / benchSeconds(listStart, listEnd), listFound, listLookups);
+    return 0;
+}
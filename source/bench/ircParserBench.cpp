@@ -0,0 +1,218 @@
+#include <stdio.h>
+#include <string.h>
+#include <irc/basicIrcConnection.h>
+#include <irc/ircParser.h>
+
+#if !defined (WIN32)
+    #include <sys/socket.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #define closesocket close
+#else
+    #define usleep(a) Sleep((a) / 1000)
+#endif
+
+//ircParserBench.cpp
+//Author: Simon Wittenberg
+
+// Measures how many lines per second reach a bot, once parsed by libirc and once by
+// IrcParser (see IrcConnection::setNativeInput(...)). A local server thread sends
+// BENCH_LINES channel messages over loopback tcp, a quarter of them with IRCv3 tags.
+// Also measures the parser alone on the same data.
+
+#define BENCH_LINES 500000
+#define BENCH_PARSER_ROUNDS 20
+
+
+static String benchPayload()
+{
+    String payload;
+    char line[512];
+    for(unsigned int i = 0; i < BENCH_LINES; i++)
+    {
+        if(i % 4 == 0)
+            sprintf(line, "@time=2016-01-01T00:00:00.000Z;msgid=bench%u :user%u!~user@host%u.example.org PRIVMSG #bench :message number %u, some chatter to fill the line\r\n", i, i % 100, i % 100, i);
+        else
+            sprintf(line, ":user%u!~user@host%u.example.org PRIVMSG #bench :message number %u, some chatter to fill the line\r\n", i % 100, i % 100, i);
+        payload.append(line);
+    }
+    return payload;
+}
+
+static double benchSeconds(millis_t start, millis_t end)
+{
+    return (end - start) / 1000.0;
+}
+
+
+class BenchBot : public BasicIrcConnection<BenchBot>
+{
+public:
+    typedef BasicIrcConnection<BenchBot> Parent;
+    enum { EventMask = IRC_EVENT_BIT(IRC_EVENT_CHANNEL) };
+
+    BenchBot() : received(0) {};
+
+    void on_event(const IrcMessageView& message)
+    {
+        // libirc does not know tags and reports tagged lines as unknown events,
+        // count them anyway so both runs see the same number of lines
+        if(message.type == IRC_EVENT_CHANNEL || message.type == IRC_EVENT_UNKNOWN)
+            received++;
+        else
+            Parent::on_event(message);
+    };
+
+    volatile unsigned int received;
+};
+
+
+struct BenchServer
+{
+    int             listener;
+    const String*   payload;
+    volatile bool   send;
+    volatile bool   done;
+    millis_t        start;
+};
+
+THREAD_FUNCTION(bench_server_thread)
+{
+    BenchServer* server = (BenchServer*) arg;
+    int client = (int)accept(server->listener, NULL, NULL);
+    if(client < 0)
+        return 0;
+
+    // wait for the registration, then complete it
+    char buf[512];
+    String received;
+    while(received.find("USER") == String::npos)
+    {
+        int length = recv(client, buf, sizeof(buf), 0);
+        if(length <= 0)
+            break;
+        received.append(buf, length);
+    }
+    const char* welcome = ":bench 001 benchbot :Welcome\r\n:bench 376 benchbot :End of MOTD\r\n";
+    send(client, welcome, (int)strlen(welcome), 0);
+
+    while(!server->send)
+        usleep(1000);
+
+    server->start = getMilliseconds();
+    const char* data = server->payload->data();
+    size_t left = server->payload->size();
+    while(left)
+    {
+        int length = send(client, data, (int)(left > 65536 ? 65536 : left), 0);
+        if(length <= 0)
+            break;
+        data += length;
+        left -= length;
+    }
+
+    while(!server->done)
+        usleep(1000);
+    closesocket(client);
+    return 0;
+}
+
+static void benchConnection(const String& payload, bool native)
+{
+    BenchServer server;
+    server.payload = &payload;
+    server.send = false;
+    server.done = false;
+    server.listener = (int)socket(AF_INET, SOCK_STREAM, 0);
+
+    struct sockaddr_in addr;
+    socklen_t addrLength = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(bind(server.listener, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || listen(server.listener, 1) != 0
+        || getsockname(server.listener, (struct sockaddr*)&addr, &addrLength) != 0)
+    {
+        printf("could not listen\n");
+        return;
+    }
+
+    thread_handle_t thread;
+    if(START_THREAD(thread, bench_server_thread, &server))
+        return;
+
+    // the bot is leaked on purpose, its thread may still run for a moment after quit
+    BenchBot* bot = new BenchBot();
+    char serverName[64];
+    sprintf(serverName, "127.0.0.1:%d", ntohs(addr.sin_port));
+    IRCServerInfo info;
+    info.server = serverName;
+    info.nick = (char*)"benchbot";
+    info.channel = (char*)"#bench";
+    bot->setNativeInput(native);
+    bot->start(&info);
+    while(!bot->isRunning())
+        usleep(1000);
+
+    server.send = true;
+    millis_t timeout = getMilliseconds() + 120000;
+    while(bot->received < BENCH_LINES && getMilliseconds() < timeout)
+        usleep(200);
+    millis_t end = getMilliseconds();
+
+    double seconds = benchSeconds(server.start, end);
+    printf("%-10s %u of %u lines in %.3f s, %.0f lines/s\n", native ? "IrcParser" : "libirc",
+        bot->received, BENCH_LINES, seconds, bot->received / (seconds > 0 ? seconds : 0.001));
+
+    bot->quit("done");
+    server.done = true;
+    JOIN_THREAD(thread);
+    closesocket(server.listener);
+}
+
+static void benchParser(const String& payload)
+{
+    const char* data = payload.data();
+    const char* end = data + payload.size();
+    unsigned int lines = 0;
+    unsigned int checksum = 0;
+
+    millis_t start = getMilliseconds();
+    for(unsigned int round = 0; round < BENCH_PARSER_ROUNDS; round++)
+    {
+        const char* begin = data;
+        while(begin < end)
+        {
+            const char* lineEnd = IrcParser::findLineEnd(begin, end);
+            IrcParsedLine line;
+            if(IrcParser::parseLine(begin, lineEnd, &line) == 0)
+            {
+                lines++;
+                checksum += line.count + (unsigned int)line.tags.size;
+            }
+            begin = lineEnd + 1;
+        }
+    }
+    double seconds = benchSeconds(start, getMilliseconds());
+    printf("%-10s %u lines in %.3f s, %.0f lines/s, %.0f MB/s (checksum %u)\n", "parse only",
+        lines, seconds, lines / (seconds > 0 ? seconds : 0.001),
+        BENCH_PARSER_ROUNDS * payload.size() / (seconds > 0 ? seconds : 0.001) / (1024 * 1024), checksum);
+}
+
+int main(int argc, char** argv)
+{
+#if defined (WIN32)
+    WSADATA wsaData;
+    if(WSAStartup(MAKEWORD(2, 2), &wsaData))
+        return 1;
+#endif
+
+    String payload = benchPayload();
+    printf("%u lines, %u bytes\n", BENCH_LINES, (unsigned int)payload.size());
+
+    benchParser(payload);
+    benchConnection(payload, false);
+    benchConnection(payload, true);
+    return 0;
+}
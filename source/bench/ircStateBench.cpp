@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <new>
+#include <irc/ircStateTracker.h>
+#include <util/threadHelper.h>
+
+//ircStateBench.cpp
+//Author: Simon Wittenberg
+
+// Measures the memory IrcStateTracker needs per user, for BENCH_USERS users in
+// BENCH_CHANNELS channels as on a large network. Every user is in the first channel and
+// in up to two others, a fifth of them share a cloaked host and most share a few user
+// names. For comparison the same users go into a std::map keyed by nick with their
+// names as std::string, the way examples/censor.cpp keeps them.
+// The tracker reports its own use, see getUserMemoryUsage(), plus the nicks it interned
+// in IrcInternPool::global(). Heap use of the map is counted by replacing operator new.
+// Both only count the users, which channels a user is in is left out on both sides. The
+// tracker only keeps in how many it is, that is in its number.
+
+#define BENCH_USERS 100000
+#define BENCH_CHANNELS 40
+#define BENCH_LOOKUP_ROUNDS 10
+
+
+static size_t benchAllocated = 0;
+
+void* operator new(size_t size)
+{
+    // the size goes in front, operator delete needs it
+    size_t* block = (size_t*)malloc(size + sizeof(size_t) * 2);
+    if(!block)
+        throw std::bad_alloc();
+    block[0] = size;
+    benchAllocated += size;
+    return block + 2;
+}
+
+void operator delete(void* data) throw()
+{
+    if(!data)
+        return;
+    size_t* block = (size_t*)data - 2;
+    benchAllocated -= block[0];
+    free(block);
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete[](void* data) throw() { operator delete(data); }
+
+
+struct BenchUser
+{
+    std::string     user;
+    std::string     host;
+};
+
+static void benchPrefix(unsigned int i, char* nick, char* user, char* host)
+{
+    sprintf(nick, "user%u", i);
+    sprintf(user, "~ident%u", i % 50);
+    if(i % 5 == 0)
+        sprintf(host, "users.example.org");
+    else
+        sprintf(host, "host-%u-%u.dsl.provider%u.example.net", i % 251, i, i % 17);
+}
+
+static void benchChannel(unsigned int i, unsigned int n, char* channel)
+{
+    // everyone is in #c0, some in one or two more
+    sprintf(channel, "#c%u", n == 0 ? 0 : 1 + (i * 7 + n * 13) % (BENCH_CHANNELS - 1));
+}
+
+static double benchSeconds(millis_t start, millis_t end)
+{
+    return (end - start) / 1000.0;
+}
+
+static void benchTracker()
+{
+    char nick[32], user[32], host[64], channel[16], prefix[160];
+    millis_t start = getMilliseconds();
+
+    IrcStateTracker* tracker = new IrcStateTracker();
+    IrcPrefix self(IrcStringView("benchbot!~bench@bench.example"));
+    for(unsigned int c = 0; c < BENCH_CHANNELS; c++)
+    {
+        sprintf(channel, "#c%u", c);
+        tracker->onJoin(IrcStringView(channel), self, true);
+    }
+    for(unsigned int i = 0; i < BENCH_USERS; i++)
+    {
+        benchPrefix(i, nick, user, host);
+        sprintf(prefix, "%s!%s@%s", nick, user, host);
+        for(unsigned int n = 0; n < 1 + i % 3; n++)
+        {
+            benchChannel(i, n, channel);
+            tracker->onJoin(IrcStringView(channel), IrcPrefix(IrcStringView(prefix)), false);
+        }
+    }
+    millis_t filled = getMilliseconds();
+
+    unsigned int found = 0;
+    for(unsigned int round = 0; round < BENCH_LOOKUP_ROUNDS; round++)
+    {
+        for(unsigned int i = 0; i < BENCH_USERS; i++)
+        {
+            sprintf(nick, "USER%u", i);
+            if(tracker->isOnChannel(IrcStringView("#C0"), IrcStringView(nick)))
+                found++;
+        }
+    }
+    millis_t looked = getMilliseconds();
+
+    printf("%-12s %u users, %.1f bytes per user\n", "tracker",
+        (unsigned int)tracker->getUserCount(),
+        (double)(tracker->getUserMemoryUsage() + IrcInternPool::global().getMemoryUsage()) / tracker->getUserCount());
+    printf("%-12s filled in %.3f s, %.0f lookups/s (%u found)\n", "",
+        benchSeconds(start, filled), BENCH_LOOKUP_ROUNDS * BENCH_USERS / (benchSeconds(filled, looked) > 0 ? benchSeconds(filled, looked) : 0.001), found);
+    delete tracker;
+}
+
+static void benchMap()
+{
+    char nick[32], user[32], host[64];
+    size_t before = benchAllocated;
+
+    std::map<std::string, BenchUser>* users = new std::map<std::string, BenchUser>();
+    for(unsigned int i = 0; i < BENCH_USERS; i++)
+    {
+        benchPrefix(i, nick, user, host);
+        BenchUser& entry = (*users)[nick];
+        entry.user = user;
+        entry.host = host;
+    }
+    printf("%-12s %u users, %.1f bytes per user\n", "std::map",
+        (unsigned int)users->size(), (double)(benchAllocated - before) / users->size());
+    delete users;
+}
+
+int main(int argc, char** argv)
+{
+    printf("%u users in %u channels\n", BENCH_USERS, BENCH_CHANNELS);
+    benchTracker();
+    benchMap();
+    return 0;
+}
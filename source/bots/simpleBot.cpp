@@ -3,6 +3,21 @@
 //simpleBot.cpp
 //Author: Simon Wittenberg
 
+SimpleBot::SimpleBot()
+{
+    _throttled = false;
+    // the handlers left empty in simpleBot.h are not subscribed, e.g. join/part/quit
+    // floods after a netsplit never reach us
+    setEventMask(IRC_EVENT_BIT(IRC_EVENT_JOIN)
+                | IRC_EVENT_BIT(IRC_EVENT_UMODE)
+                | IRC_EVENT_BIT(IRC_EVENT_CHANNEL)
+                | IRC_EVENT_BIT(IRC_EVENT_CHANNEL_NOTICE)
+                | IRC_EVENT_BIT(IRC_EVENT_CTCP_REQ)
+                | IRC_EVENT_BIT(IRC_EVENT_CTCP_REP)
+                | IRC_EVENT_BIT(IRC_EVENT_CTCP_ACTION)
+                | IRC_EVENT_BIT(IRC_EVENT_NUMERIC));
+}
+
 void SimpleBot::on_connect(const String event, const String server, const String myNick, const StringVector params)
 {
     Parent::on_connect(event, server, myNick, params);
@@ -13,13 +28,13 @@ void SimpleBot::on_join(const String event, const String nick, const String chan
 {
     //_dumpData("on_join",event,origin,params, count);
 
-    if(nick.compare(_serverInfo.nick)==0)
+    if(isOwnNick(nick))
     {
         sendMessage(channel, "Here I am!");
     }
     else
     {
-        sendMessage(channel, String("Hi, ").append(nick));
+        (IrcLineBuilder(*this, "PRIVMSG", channel) << "Hi, " << nick).send();
     }
 }
 
@@ -28,19 +43,19 @@ void SimpleBot::on_channel(const String event, const String nick, const String c
     printf("on_channel\n"
           "[%s]::[%s] : [%s]\n", channel.c_str(), nick.c_str(), msg.c_str());
 
-    if(nick.compare(_serverInfo.nick) == 0)
+    if(isOwnNick(nick))
         return; // don't react further to anything we post ourselves
     size_t found;
 
     String cueWord("Cue");
     found = msg.find(cueWord);
-    if (found!=String::npos)
-        sendMessage(channel, String("@").append(nick).append(String(", ").append(String("My Cue!"))));
+    if (found!=String::npos && !_throttled)
+        (IrcLineBuilder(*this, "PRIVMSG", channel) << "@" << nick << ", My Cue!").send();
     
     String helloBot = String("Hallo ").append(_serverInfo.nick);
     found = msg.find(helloBot);
-    if (found!=String::npos)
-        sendMessage(channel, String("Hallo, ").append(nick));
+    if (found!=String::npos && !_throttled)
+        (IrcLineBuilder(*this, "PRIVMSG", channel) << "Hallo, " << nick).send();
 
     String quitcommand("?quit");
     found = msg.find(quitcommand);
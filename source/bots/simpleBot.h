@@ -5,12 +5,15 @@
 //Author: Simon Wittenberg
 
 #include <irc/ircconnection.h>
+#include <irc/ircLineBuilder.h>
 
 class SimpleBot : public IrcConnection
 {
 public:
     typedef IrcConnection Parent;
 
+    SimpleBot();
+
     virtual void on_connect(const String event, const String server, const String myNick, const StringVector params);
     virtual void on_nick(const String event, const String oldNick, const String newNick){};
     virtual void on_quit(const String event, const String nick, const String reason)
@@ -43,10 +46,11 @@ public:
     {
         Parent::on_numeric_code(event, origin, params);
         unsigned int count = params.size();
+        const char* name = irc_numeric_name(event);
         printf("Function name : %s \n"
                "event         : %s (%d) \n"
                "origin        : %s \n"
-               "count         : %d \n", "on_numeric_code", irc_strerror(event), event , origin.c_str(), count);
+               "count         : %d \n", "on_numeric_code", name ? name : "unknown", event , origin.c_str(), count);
         for(unsigned int i = 0; i < count; i++)
             printf("params[%d]    : %s \n", i, params[i].c_str());
         printf("---------------------\n");
@@ -70,7 +74,12 @@ public:
                "dccid         : %d \n", "on_dcc_send_req", nick.c_str(), addr.c_str(), filename.c_str(), size, dccid);
         printf("---------------------\n");
     };
+    // while the server can't keep up with our replies we stop adding to them
+    virtual void on_send_buffer_high(size_t pending){ _throttled = true; };
+    virtual void on_send_buffer_drained(size_t pending){ _throttled = false; };
 private:
+    bool _throttled;
+
     void _dumpData(const char* funcName, const String event, const String origin, const StringVector params);
 };
 
@@ -0,0 +1,124 @@
+#ifndef _BASIC_IRC_CONNECTION_H_
+#define _BASIC_IRC_CONNECTION_H_
+#include <irc/ircConnection.h>
+
+//basicIrcConnection.h
+//Author: Simon Wittenberg
+
+// An IrcConnection that dispatches events statically to the derived class instead of
+// through the virtual on_*(...) methods. Each event gets its own callback, instantiated
+// for the derived class, which calls Derived::on_event(...) directly. The compiler can
+// thus inline the whole path from libirc to the handler and, as the event type is a
+// constant there, drop the branches of on_event(...) that do not apply.
+//
+// Derived classes may declare the events they handle at compile time through an
+// EventMask, the default subscribes to all of them (see IrcConnection::setEventMask(...)).
+// Everything else, including the virtual on_*(...) methods, works like in IrcConnection.
+//
+// Usage:
+//      class MyBot : public BasicIrcConnection<MyBot>
+//      {
+//      public:
+//          typedef BasicIrcConnection<MyBot> Parent;
+//          enum { EventMask = IRC_EVENT_BIT(IRC_EVENT_CHANNEL) };
+//
+//          void on_event(const IrcMessageView& message)
+//          {
+//              if(message.type == IRC_EVENT_CHANNEL)
+//                  ...;
+//              else
+//                  Parent::on_event(message);   // connect and unknown are handled there
+//          }
+//      };
+
+template <class Derived>
+class BasicIrcConnection : public IrcConnection
+{
+public:
+    enum { EventMask = IRC_EVENT_MASK_ALL };
+
+    BasicIrcConnection()
+    {
+        setEventMask(Derived::EventMask);
+    };
+
+protected:
+    // installs the statically dispatching callbacks for all events IrcConnection subscribed to
+    virtual void _setCallbacks()
+    {
+        IrcConnection::_setCallbacks();
+
+#define BASIC_IRC_CONNECTION_SET_CALLBACK(member, type) \
+        if(_callbacks.member) \
+            _callbacks.member = &BasicIrcConnection::template _event<type>;
+
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_connect,        IRC_EVENT_CONNECT)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_nick,           IRC_EVENT_NICK)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_quit,           IRC_EVENT_QUIT)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_join,           IRC_EVENT_JOIN)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_part,           IRC_EVENT_PART)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_mode,           IRC_EVENT_MODE)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_umode,          IRC_EVENT_UMODE)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_topic,          IRC_EVENT_TOPIC)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_kick,           IRC_EVENT_KICK)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_channel,        IRC_EVENT_CHANNEL)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_privmsg,        IRC_EVENT_PRIVMSG)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_notice,         IRC_EVENT_NOTICE)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_channel_notice, IRC_EVENT_CHANNEL_NOTICE)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_invite,         IRC_EVENT_INVITE)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_ctcp_req,       IRC_EVENT_CTCP_REQ)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_ctcp_rep,       IRC_EVENT_CTCP_REP)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_ctcp_action,    IRC_EVENT_CTCP_ACTION)
+        BASIC_IRC_CONNECTION_SET_CALLBACK(event_unknown,        IRC_EVENT_UNKNOWN)
+#undef BASIC_IRC_CONNECTION_SET_CALLBACK
+
+        if(_callbacks.event_numeric)
+            _callbacks.event_numeric = &BasicIrcConnection::_numeric;
+
+        _viewDispatcher = &BasicIrcConnection::_dispatchView;
+    };
+
+private:
+    template <IrcEventType Type>
+    static void _event(irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
+    {
+        _dispatch(session, Type, 0, event, origin, params, count);
+    };
+
+    static void _numeric(irc_session_t * session, unsigned int event, const char * origin, const char ** params, unsigned int count)
+    {
+        _dispatch(session, IRC_EVENT_NUMERIC, event, NULL, origin, params, count);
+    };
+
+    static void _dispatch(irc_session_t * session, IrcEventType type, unsigned int numeric, const char * event, const char * origin, const char ** params, unsigned int count)
+    {
+        IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
+        Return_Void_Unless(connection);
+        IrcMessageView message;
+        char eventText[4];
+        irc_connection_make_view(message, type, numeric, event, eventText, origin, params, count);
+        if(type == IRC_EVENT_NUMERIC)
+        {
+            Return_Void_Unless(connection->wantsMessage(message));
+            MutexHandle connectionMutex(connection->getMutex());
+            connection->dispatchMessage(message);   // may have a numeric handler
+            return;
+        }
+
+        // type is a constant once this is inlined into _event<Type>
+        MutexHandle connectionMutex(connection->getMutex());
+        BasicIrcConnection* basic = static_cast<BasicIrcConnection*>(connection);
+        if(IRC_EVENT_BIT(type) & (IRC_EVENT_MASK_TRACKED | IRC_EVENT_MASK_STATE) & basic->_trackedMask)
+            basic->_trackMessage(message);
+        if(basic->_sessionEventMask & IRC_EVENT_BIT(type))
+            _dispatchView(connection, message);
+    };
+
+    static void _dispatchView(IrcConnection* connection, const IrcMessageView& message)
+    {
+        // qualified call, so it is not dispatched through the vtable
+        static_cast<Derived*>(connection)->Derived::on_event(message);
+    };
+};
+
+#endif //_BASIC_IRC_CONNECTION_H_
@@ -0,0 +1,131 @@
+#include "ircCaseMapping.h"
+#include <util/util.h>
+
+//ircCaseMapping.cpp
+//Author: Simon Wittenberg
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define IRC_CASE_MAPPING_SSE2
+    #include <emmintrin.h>
+#endif
+
+#define IRC_CASE_MAPPING_BLOCK 16
+
+
+#if defined (IRC_CASE_MAPPING_SSE2)
+// adds 0x20 to every byte in ('A' - 1, last + 1). Bytes from 0x80 up are negative
+// for the signed compares and so never in range
+static inline __m128i irc_case_fold_block(__m128i block, __m128i below, __m128i above)
+{
+    __m128i mask = _mm_and_si128(_mm_cmpgt_epi8(block, below), _mm_cmplt_epi8(block, above));
+    return _mm_add_epi8(block, _mm_and_si128(mask, _mm_set1_epi8('a' - 'A')));
+}
+#endif
+
+void IrcCaseMapping::setType(IrcCaseMappingType type)
+{
+    _type = type;
+    switch(type)
+    {
+    case IRC_CASEMAPPING_ASCII:             _last = 'Z';    break;
+    case IRC_CASEMAPPING_STRICT_RFC1459:    _last = ']';    break;
+    default:                                _last = '^';    break;
+    }
+}
+
+bool IrcCaseMapping::setName(const IrcStringView& name)
+{
+    if(name.equals("rfc1459"))
+        setType(IRC_CASEMAPPING_RFC1459);
+    else if(name.equals("strict-rfc1459"))
+        setType(IRC_CASEMAPPING_STRICT_RFC1459);
+    else
+    {
+        setType(IRC_CASEMAPPING_ASCII);
+        return name.equals("ascii");
+    }
+    return true;
+}
+
+void IrcCaseMapping::fold(const char* in, size_t size, char* out) const
+{
+    size_t i = 0;
+#if defined (IRC_CASE_MAPPING_SSE2)
+    const __m128i below = _mm_set1_epi8('A' - 1);
+    const __m128i above = _mm_set1_epi8((char)(_last + 1));
+    for(; i + IRC_CASE_MAPPING_BLOCK <= size; i += IRC_CASE_MAPPING_BLOCK)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)(in + i));
+        _mm_storeu_si128((__m128i*)(out + i), irc_case_fold_block(block, below, above));
+    }
+#endif
+    for(; i < size; i++)
+        out[i] = fold(in[i]);
+}
+
+std::string IrcCaseMapping::fold(const IrcStringView& name) const
+{
+    std::string folded(name.size, '\0');
+    if(name.size)
+        fold(name.data, name.size, &folded[0]);
+    return folded;
+}
+
+bool IrcCaseMapping::equals(const IrcStringView& a, const IrcStringView& b) const
+{
+    Return_False_Unless(a.size == b.size);
+    size_t i = 0;
+#if defined (IRC_CASE_MAPPING_SSE2)
+    const __m128i below = _mm_set1_epi8('A' - 1);
+    const __m128i above = _mm_set1_epi8((char)(_last + 1));
+    for(; i + IRC_CASE_MAPPING_BLOCK <= a.size; i += IRC_CASE_MAPPING_BLOCK)
+    {
+        __m128i left = irc_case_fold_block(_mm_loadu_si128((const __m128i*)(a.data + i)), below, above);
+        __m128i right = irc_case_fold_block(_mm_loadu_si128((const __m128i*)(b.data + i)), below, above);
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(left, right)) != 0xffff)
+            return false;
+    }
+#endif
+    for(; i < a.size; i++)
+        if(fold(a.data[i]) != fold(b.data[i]))
+            return false;
+    return true;
+}
+
+static inline unsigned int irc_case_rotate(unsigned int value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+unsigned int IrcCaseMapping::hash(const IrcStringView& name) const
+{
+    // murmur3 over the folded name, a block at a time. The last block is padded with
+    // zeros, the length going in first keeps "a" and "a\0" apart
+    unsigned int hash = 2166136261u ^ (unsigned int)name.size;
+    char folded[IRC_CASE_MAPPING_BLOCK];
+    for(size_t i = 0; i < name.size; i += IRC_CASE_MAPPING_BLOCK)
+    {
+        size_t size = name.size - i < IRC_CASE_MAPPING_BLOCK ? name.size - i : IRC_CASE_MAPPING_BLOCK;
+        fold(name.data + i, size, folded);
+        for(size_t pad = size; pad % 4; pad++)
+            folded[pad] = 0;
+        for(size_t word = 0; word < size; word += 4)
+        {
+            unsigned int k = (unsigned char)folded[word]
+                | ((unsigned char)folded[word + 1] << 8)
+                | ((unsigned char)folded[word + 2] << 16)
+                | ((unsigned int)(unsigned char)folded[word + 3] << 24);
+            k *= 0xcc9e2d51u;
+            k = irc_case_rotate(k, 15);
+            k *= 0x1b873593u;
+            hash ^= k;
+            hash = irc_case_rotate(hash, 13) * 5 + 0xe6546b64u;
+        }
+    }
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash == (unsigned int)-1 ? hash - 1 : hash;
+}
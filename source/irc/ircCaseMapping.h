@@ -0,0 +1,62 @@
+#ifndef _IRC_CASE_MAPPING_H_
+#define _IRC_CASE_MAPPING_H_
+#include <string>
+#include <irc/ircMessage.h>
+
+//ircCaseMapping.h
+//Author: Simon Wittenberg
+
+// Which nicks and channel names a server considers the same, as it says in CASEMAPPING
+// (RPL_ISUPPORT). All three mappings in use map a single range of characters to the
+// range 32 above it:
+//      ascii           "A-Z"       to "a-z"
+//      strict-rfc1459  "A-Z[\]"    to "a-z{|}"
+//      rfc1459         "A-Z[\]^"   to "a-z{|}~", the default
+// Folding, comparing and hashing work on whole blocks of 16 characters with SSE2 where
+// available, so tables keyed by names never need a lower case copy of them.
+
+enum IrcCaseMappingType
+{
+    IRC_CASEMAPPING_ASCII = 0,
+    IRC_CASEMAPPING_STRICT_RFC1459,
+    IRC_CASEMAPPING_RFC1459
+};
+
+class IrcCaseMapping
+{
+public:
+    IrcCaseMapping(IrcCaseMappingType type = IRC_CASEMAPPING_RFC1459) { setType(type); };
+
+    void setType(IrcCaseMappingType type);
+    IrcCaseMappingType getType() const { return _type; };
+
+    // sets the mapping CASEMAPPING names, unknown ones (e.g. rfc7613) fold ascii only.
+    // Returns false for those
+    bool setName(const IrcStringView& name);
+
+    char fold(char c) const
+    {
+        unsigned char u = (unsigned char)c;
+        return (u >= 'A' && u <= _last) ? (char)(u + ('a' - 'A')) : c;
+    };
+    // folds size characters of in to out, in and out may be the same
+    void fold(const char* in, size_t size, char* out) const;
+    std::string fold(const IrcStringView& name) const;
+
+    bool equals(const IrcStringView& a, const IrcStringView& b) const;
+    bool equals(const std::string& a, const IrcStringView& b) const { return equals(IrcStringView(a.data(), a.size()), b); };
+
+    // the same for names that are equal, never (unsigned int)-1, so it can key an
+    // OpenHashMap as it is
+    unsigned int hash(const IrcStringView& name) const;
+
+    bool operator==(const IrcCaseMapping& other) const { return _type == other._type; };
+    bool operator!=(const IrcCaseMapping& other) const { return _type != other._type; };
+
+private:
+    IrcCaseMappingType  _type;
+    // the last character that is folded, 'Z', ']' or '^'
+    unsigned char       _last;
+};
+
+#endif //_IRC_CASE_MAPPING_H_
@@ -1,215 +1,178 @@
 #include "ircConnection.h"
+#include <time.h>
+#include <util/fdSet.h>
+#include <irc/ircLineBuilder.h>
+
+#if !defined (WIN32)
+    #include <sys/socket.h>
+#endif
 
 //ircConnection.cpp
 //Author: Simon Wittenberg
 
 
-StringVector paramsToStringVector(const char ** params, const unsigned int count, const unsigned int start = 0)
+StringVector paramsToStringVector(const IrcMessageView& message, const unsigned int start = 0)
 {
     StringVector returnVector;
-    for(unsigned int i = start; i < count; i++)
+    for(unsigned int i = start; i < message.count; i++)
     {
-        returnVector.push_back(String(params[i]));
+        returnVector.push_back(message.params[i].toString());
     }
     return returnVector;
 }
 
 
-void irc_connection_event_connect (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count >= 1);
-    MutexHandle connectionMutex(connection->getMutex());
-    String server(origin ? origin : "");
-    String myNick(params[0]);
-    StringVector parameter = paramsToStringVector(params, count, 2);
-    connection->on_connect( String(event), server, myNick, parameter);
-}
-void irc_connection_event_nick (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count == 1);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick;
-    connection->getNick(origin ? origin : "", &nick);
-    connection->on_nick( String(event), nick, String(params[0]));
-}
-void irc_connection_event_quit (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count == 1);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick; 
-    connection->getNick(origin ? origin : "", &nick);
-    connection->on_quit( String(event), nick, String(params[0]));
-}
-void irc_connection_event_join (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count == 1);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick;
-    connection->getNick(origin ? origin : "", &nick);
-    connection->on_join( String(event), nick, String(params[0]));
-}
-void irc_connection_event_part (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick;
-    connection->getNick(origin ? origin : "", &nick);
-    connection->on_part( String(event), nick, String(params[0]));
-}
-void irc_connection_event_mode (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count >= 2);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick; 
-    connection->getNick(origin ? origin : "", &nick);
-    String channel(params[0]);
-    String modes(params[1]);
-    StringVector parameter = paramsToStringVector(params, count, 2);
-    connection->on_mode( String(event), nick, channel, modes, parameter);
-}
-void irc_connection_event_umode (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection);
-    MutexHandle connectionMutex(connection->getMutex());
-    StringVector parameter = paramsToStringVector(params, count);
-    connection->on_umode( String(event), String(origin ? origin : ""), parameter);
-}
-void irc_connection_event_kick (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count == 3);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick; 
-    connection->getNick(origin ? origin : "", &nick);
-    String channel(params[0]);
-    String target(params[1]);
-    String kickMsg(params[2]);
-    connection->on_kick( String(event), nick, channel, target , kickMsg);
-}
-void irc_connection_event_topic (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick; 
-    connection->getNick(origin ? origin : "", &nick);
-    String channel(params[0]);
-    String topic(params[1]);
-    connection->on_topic( String(event), nick, channel, topic);
-}
-void irc_connection_event_channel (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    Return_Void_Unless(origin && count == 2);
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick;
-    connection->getNick(origin ? origin : "", &nick);
-    connection->on_channel( String(event), nick, String(params[0]), String(params[1]));
-}
-void irc_connection_event_privmsg (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count == 2);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick;
-    connection->getNick(origin ? origin : "", &nick);
-    String msg(params[1]); // params[0] is our own nick
-    connection->on_private_message( String(event), nick, msg);
-}
-void irc_connection_event_notice (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count == 2);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick;
-    connection->getNick(origin ? origin : "", &nick);
-    String msg(params[1]); // params[0] is our own nick
-    connection->on_notice( String(event), nick, msg);
-}
-void irc_connection_event_channel_notice (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection);
-    MutexHandle connectionMutex(connection->getMutex());
-    StringVector parameter = paramsToStringVector(params, count);
-    connection->on_channel_notice( String(event), String(origin ? origin : ""), parameter);
-    
-    // I guess it would look like this:
-    //String nick;
-    //connection->getNick(origin ? origin : "");
-    //String msg(params[1]); // params[0] is our own nick
-    //connection->on_channel_notice( String(event), nick, channel, msg);
-}
-void irc_connection_event_invite (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection && count == 2);
-    MutexHandle connectionMutex(connection->getMutex());
-    String nick;
-    connection->getNick(origin ? origin : "", &nick);
-    String channel(params[1]); // params[0] is our own nick
-    connection->on_invite( String(event), nick, channel);
-}
-void irc_connection_event_ctcp_req (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
+// All event callbacks of libirc end up here. The view is built on the stack and points into
+// the receive buffer of the session, nothing is copied or allocated on the way to on_event(...)
+void irc_connection_dispatch (IrcEventType type, unsigned int numeric, irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
 {
     IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
     Return_Void_Unless(connection);
+    IrcMessageView message;
+    char eventText[4];
+    irc_connection_make_view(message, type, numeric, event, eventText, origin, params, count);
+    Return_Void_Unless(connection->wantsMessage(message));
     MutexHandle connectionMutex(connection->getMutex());
-    StringVector parameter = paramsToStringVector(params, count);
-    connection->on_ctcp_request( String(event), String(origin ? origin : ""), parameter);
-}
-void irc_connection_event_ctcp_rep (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
+    connection->dispatchMessage(message);
+}
+
+void irc_connection_dispatch_view (IrcConnection* connection, const IrcMessageView& message)
 {
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection);
-    MutexHandle connectionMutex(connection->getMutex());
-    StringVector parameter = paramsToStringVector(params, count);
-    connection->on_ctcp_reply( String(event), String(origin ? origin : ""), parameter);
+    connection->on_event(message);
 }
-void irc_connection_event_unknown (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection);
-    MutexHandle connectionMutex(connection->getMutex());
-    StringVector parameter = paramsToStringVector(params, count);
-    connection->on_unknown( String(event), String(origin ? origin : ""), parameter);
-}
-void irc_connection_event_ctcp_action (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count)
-{
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection);
-    MutexHandle connectionMutex(connection->getMutex());
-    StringVector parameter = paramsToStringVector(params, count);
-    connection->on_ctcp_action( String(event), String(origin ? origin : ""), parameter);
+
+#define IRC_CONNECTION_EVENT(name, type) \
+void irc_connection_event_##name (irc_session_t * session, const char * event, const char * origin, const char ** params, unsigned int count) \
+{ \
+    irc_connection_dispatch(type, 0, session, event, origin, params, count); \
 }
+
+IRC_CONNECTION_EVENT(connect,           IRC_EVENT_CONNECT)
+IRC_CONNECTION_EVENT(nick,              IRC_EVENT_NICK)
+IRC_CONNECTION_EVENT(quit,              IRC_EVENT_QUIT)
+IRC_CONNECTION_EVENT(join,              IRC_EVENT_JOIN)
+IRC_CONNECTION_EVENT(part,              IRC_EVENT_PART)
+IRC_CONNECTION_EVENT(mode,              IRC_EVENT_MODE)
+IRC_CONNECTION_EVENT(umode,             IRC_EVENT_UMODE)
+IRC_CONNECTION_EVENT(kick,              IRC_EVENT_KICK)
+IRC_CONNECTION_EVENT(topic,             IRC_EVENT_TOPIC)
+IRC_CONNECTION_EVENT(channel,           IRC_EVENT_CHANNEL)
+IRC_CONNECTION_EVENT(privmsg,           IRC_EVENT_PRIVMSG)
+IRC_CONNECTION_EVENT(notice,            IRC_EVENT_NOTICE)
+IRC_CONNECTION_EVENT(channel_notice,    IRC_EVENT_CHANNEL_NOTICE)
+IRC_CONNECTION_EVENT(invite,            IRC_EVENT_INVITE)
+IRC_CONNECTION_EVENT(ctcp_req,          IRC_EVENT_CTCP_REQ)
+IRC_CONNECTION_EVENT(ctcp_rep,          IRC_EVENT_CTCP_REP)
+IRC_CONNECTION_EVENT(unknown,           IRC_EVENT_UNKNOWN)
+IRC_CONNECTION_EVENT(ctcp_action,       IRC_EVENT_CTCP_ACTION)
+
 void irc_connection_event_numeric (irc_session_t * session, unsigned int event, const char * origin, const char ** params, unsigned int count)
 {
-    IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
-    Return_Void_Unless(connection);
-    MutexHandle connectionMutex(connection->getMutex());
-    StringVector parameter = paramsToStringVector(params, count);
-    connection->on_numeric_code( event, String(origin ? origin : ""), parameter);
+    irc_connection_dispatch(IRC_EVENT_NUMERIC, event, session, NULL, origin, params, count);
 }
 void irc_connection_event_dcc_chat_req (irc_session_t * session, const char * nick, const char * addr, irc_dcc_t dccid)
 {
     IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
     Return_Void_Unless(connection);
+    // the whole origin, what libirc used to pass with LIBIRC_OPTION_STRIPNICKS is its nick
+    IrcStringView sender = IrcPrefix(IrcStringView(nick)).nick;
     MutexHandle connectionMutex(connection->getMutex());
-    connection->on_dcc_chat_req( String(nick), String(addr), dccid);
+    connection->on_dcc_chat_req( String(sender.data, sender.size), String(addr), dccid);
 }
 void irc_connection_event_dcc_send_req (irc_session_t * session, const char * nick, const char * addr, const char * filename, unsigned long size, irc_dcc_t dccid)
 {
     IrcConnection* connection = (IrcConnection*) irc_get_ctx( session );
     Return_Void_Unless(connection);
+    IrcStringView sender = IrcPrefix(IrcStringView(nick)).nick;
     MutexHandle connectionMutex(connection->getMutex());
-    connection->on_dcc_send_req( String(nick), String(addr), String(filename), size, dccid);
+    connection->on_dcc_send_req( String(sender.data, sender.size), String(addr), String(filename), size, dccid);
+}
+
+
+// void IrcConnection :: _dispatchLegacy(...)
+//
+// turns the view into Strings and calls the matching on_*(...) method,
+// this is what on_event(...) does unless it is overwritten
+void IrcConnection :: _dispatchLegacy(const IrcMessageView& message)
+{
+    const IrcStringView* params = message.params;
+    const unsigned int count = message.count;
+    String event(message.event.toString());
+    // what libirc used to pass as origin with LIBIRC_OPTION_STRIPNICKS
+    String nick(message.prefix.nick.toString());
+    switch(message.type)
+    {
+    case IRC_EVENT_CONNECT:
+        Return_Void_Unless(count >= 1);
+        on_connect(event, nick, params[0].toString(), paramsToStringVector(message, 2));
+        break;
+    case IRC_EVENT_NICK:
+        Return_Void_Unless(count == 1);
+        on_nick(event, nick, params[0].toString());
+        break;
+    case IRC_EVENT_QUIT:
+        Return_Void_Unless(count == 1);
+        on_quit(event, nick, params[0].toString());
+        break;
+    case IRC_EVENT_JOIN:
+        Return_Void_Unless(count == 1);
+        on_join(event, nick, params[0].toString());
+        break;
+    case IRC_EVENT_PART:
+        Return_Void_Unless(count >= 1);
+        on_part(event, nick, params[0].toString());
+        break;
+    case IRC_EVENT_MODE:
+        Return_Void_Unless(count >= 2);
+        on_mode(event, nick, params[0].toString(), params[1].toString(), paramsToStringVector(message, 2));
+        break;
+    case IRC_EVENT_UMODE:
+        on_umode(event, nick, paramsToStringVector(message));
+        break;
+    case IRC_EVENT_KICK:
+        Return_Void_Unless(count == 3);
+        on_kick(event, nick, params[0].toString(), params[1].toString(), params[2].toString());
+        break;
+    case IRC_EVENT_TOPIC:
+        Return_Void_Unless(count >= 1);
+        on_topic(event, nick, params[0].toString(), message.param(1).toString());
+        break;
+    case IRC_EVENT_CHANNEL:
+        Return_Void_Unless(!message.origin.empty() && count == 2);
+        on_channel(event, nick, params[0].toString(), params[1].toString());
+        break;
+    case IRC_EVENT_PRIVMSG:
+        Return_Void_Unless(count == 2);
+        on_private_message(event, nick, params[1].toString()); // params[0] is our own nick
+        break;
+    case IRC_EVENT_NOTICE:
+        Return_Void_Unless(count == 2);
+        on_notice(event, nick, params[1].toString()); // params[0] is our own nick
+        break;
+    case IRC_EVENT_CHANNEL_NOTICE:
+        on_channel_notice(event, nick, paramsToStringVector(message));
+        break;
+    case IRC_EVENT_INVITE:
+        Return_Void_Unless(count == 2);
+        on_invite(event, nick, params[1].toString()); // params[0] is our own nick
+        break;
+    case IRC_EVENT_CTCP_REQ:
+        on_ctcp_request(event, nick, paramsToStringVector(message));
+        break;
+    case IRC_EVENT_CTCP_REP:
+        on_ctcp_reply(event, nick, paramsToStringVector(message));
+        break;
+    case IRC_EVENT_CTCP_ACTION:
+        on_ctcp_action(event, nick, paramsToStringVector(message));
+        break;
+    case IRC_EVENT_NUMERIC:
+        on_numeric_code(message.numeric, nick, paramsToStringVector(message));
+        break;
+    case IRC_EVENT_UNKNOWN:
+    default:
+        on_unknown(event, nick, paramsToStringVector(message));
+        break;
+    }
 }
 
 THREAD_FUNCTION(irc_connection_run_thread)
@@ -223,11 +186,58 @@ THREAD_FUNCTION(irc_connection_run_thread)
 IrcConnection::IrcConnection()
 {
     _session = NULL;
+    _eventMask = IRC_EVENT_MASK_ALL;
+    _numericHandlers = NULL;
+    _lanes[IRC_LANE_KEEPALIVE].setBudget(0, 0, IRC_FLOOD_DEFAULT_WINDOW);
+    _lanes[IRC_LANE_CONTROL].setBudget(IRC_FLOOD_CONTROL_LINES, IRC_FLOOD_CONTROL_BYTES, IRC_FLOOD_DEFAULT_WINDOW);
+    _lanes[IRC_LANE_BULK].setBudget(IRC_FLOOD_BULK_LINES, IRC_FLOOD_BULK_BYTES, IRC_FLOOD_DEFAULT_WINDOW);
+    // the server counts every line, whatever lane it came from
+    for(unsigned int lane = 0; lane < IRC_LANE_COUNT; lane++)
+        _lanes[lane].setSharedBudget(&_floodBudget);
+    _outboundDeadline = 0;
+    _sendBufferHighMark = IRC_SEND_BUFFER_HIGH;
+    _sendBufferLowMark = IRC_SEND_BUFFER_LOW;
+    _sendBufferHigh = false;
+    _sendWriting = false;
+    IrcServerCapsHandle(new IrcServerCaps()).swap(_capsHandle);
+    _caps = _capsHandle.get();
+    _stateTracking = true;
+    _stateSnapshots = false;
     _setCallbacks();
+    _nativeInput = true;
+    _nativeSession = false;
+    _socket = -1;
+    _inBuffer = NULL;
+    _inLength = 0;
+    _inSkipLine = false;
+    _motdReceived = false;
     _port = 6667;
     _running = false;
     _tryingToConnect = false;
     _reconectDelay = 0;
+    _reactorLoop = NULL;
+    _nextConnectAttempt = 0;
+    _connectRetries = 0;
+    _sessionGeneration = 0;
+    _wakeup = NULL;
+    INIT_MUTEX(_mutex);
+    INIT_MUTEX(_innerMutex);
+    INIT_MUTEX(_snapshotMutex);
+}
+
+IrcConnection::~IrcConnection()
+{
+    // too late for derived classes, see detach(), but a plain IrcConnection is still whole here
+    detach();
+
+    if(_session)
+        irc_destroy_session(_session);
+    delete _wakeup;
+    free(_inBuffer);
+    delete[] _numericHandlers;
+    DESTROY_MUTEX(_mutex);
+    DESTROY_MUTEX(_innerMutex);
+    DESTROY_MUTEX(_snapshotMutex);
 }
 
 void IrcConnection::setServerInfo(IRCServerInfo servInfo)
@@ -241,7 +251,7 @@ int IrcConnection::start(IRCServerInfo* serverInfo/* = NULL*/)
     
 
     MutexHandle innerHandle(&_innerMutex);
-    if(_running)
+    if(_running || _reactorLoop)
         return 1;
 
     // just to make sure all values are reset and there's no lingering connection
@@ -263,6 +273,39 @@ int IrcConnection::start(IRCServerInfo* serverInfo/* = NULL*/)
     return 0;
 }
 
+int IrcConnection::attachTo(IrcReactor* reactor, IRCServerInfo* serverInfo/* = NULL*/)
+{
+    Return_MinusOne_Unless(reactor);
+
+    MutexHandle innerHandle(&_innerMutex);
+    if(_running || _reactorLoop)
+        return 1;
+
+    _tryingToConnect = false;
+    if(_session)
+        irc_cmd_quit(_session, "Default.\n");
+
+    if(serverInfo)
+        _serverInfo = *serverInfo;
+
+    // the reactor takes care of (re)connecting from here on, see tick(...)
+    _tryingToConnect = true;
+    _nextConnectAttempt = 0;
+    _connectRetries = 0;
+
+    _reactorLoop = reactor->add(this);
+    Return_MinusOne_Unless(_reactorLoop);
+    return 0;
+}
+
+void IrcConnection::detach()
+{
+    // the loop may be about to process us, it has to let go first
+    IrcReactorLoop* loop = getReactorLoop();
+    if(loop)
+        loop->detach(this);
+}
+
 void IrcConnection::run()
 {
     while(doesReconnect())
@@ -279,46 +322,19 @@ void IrcConnection::run()
         if(_running)
             return;
 
-        if(_session)
-        {
-            irc_destroy_session(_session);
-            _session = NULL;
-        }
-
-        _session = irc_create_session (&_callbacks);
-
-        if ( !_session )
-        {
-            printf ("Could not create IRC session\n");
+        if(_openSession())
             return;
-        }
-
-        irc_set_ctx (_session, this);
-        irc_option_set (_session, LIBIRC_OPTION_STRIPNICKS);
-
-        // If the port number is specified in the server string, use the port 0 so it gets parsed
-        if ( strchr( _serverInfo.server, ':' ) != 0 )
-            _port = 0;
-
-        // To handle the "SSL certificate verify failed" from command line we allow passing ## in front 
-        // of the server name, and in this case tell libircclient not to verify the cert
-        if ( _serverInfo.server[0] == '#' && _serverInfo.server[1] == '#' )
-        {
-            // Skip the first character as libircclient needs only one # for SSL support, i.e. #irc.freenode.net
-            _serverInfo.server++;
-            
-            irc_option_set( _session, LIBIRC_OPTION_SSL_NO_VERIFY );
-        }
 
+        if(!_wakeup)
+            _wakeup = new WakeupChannel();
 
         // Initiate the IRC server connection
         int max_retry_count = 10;
         int retry_count = 0;
         while(true)
         {
-            if ( irc_connect (_session, _serverInfo.server, _port, 0, _serverInfo.nick, 0, 0) )
+            if ( _connectSession(retry_count) )
             {
-                printf ("Try #%d : Could not connect: %s (Server: %s ) \n", retry_count+1, irc_strerror (irc_errno(_session)), _serverInfo.server );
                 if(retry_count == max_retry_count)
                 {
                     printf("Giving up.\n\n");
@@ -332,14 +348,11 @@ void IrcConnection::run()
                 }
             }
             else
-            {
-                printf("Success! We're connected.\n");
                 break;
-            }
         }
         _running = true;
         innerHandle.release();
-        if ( irc_run (_session) )
+        if ( _runSession() )
         {
             MutexHandle innerHandle(&_innerMutex);
             _running = false;
@@ -349,6 +362,651 @@ void IrcConnection::run()
     }
 }
 
+int IrcConnection::_runSession()
+{
+    // irc_run() only adds the socket to the write set if something was queued before it went
+    // into select, so anything sent from another thread would wait out the whole timeout.
+    // This is the same loop, but sendMessage(...) and friends interrupt it through _wakeup.
+    while ( irc_is_connected(_session) )
+    {
+        struct timeval tv;
+        fd_set in_set, out_set;
+        int maxfd = 0;
+
+        // wake up in time for the next line the flood control holds back
+        MutexHandle innerHandle(&_innerMutex);
+        millis_t now = getMilliseconds();
+        millis_t deadline = _flushOutbound(now);
+        innerHandle.release();
+        _notifySendBuffer();
+        millis_t timeout = 250;
+        if(deadline && deadline - now < timeout)
+            timeout = deadline - now;
+
+        tv.tv_usec = (long)timeout * 1000;
+        tv.tv_sec = 0;
+
+        FD_ZERO (&in_set);
+        FD_ZERO (&out_set);
+
+        innerHandle.aquire(&_innerMutex);
+        _addSessionDescriptors (&in_set, &out_set, &maxfd);
+        innerHandle.release();
+
+        int wakefd = _wakeup->getDescriptor();
+        if(wakefd >= 0)
+        {
+            FD_SET (wakefd, &in_set);
+            if(wakefd > maxfd)
+                maxfd = wakefd;
+        }
+
+        if ( select (maxfd + 1, &in_set, &out_set, 0, &tv) < 0 )
+        {
+#if !defined (WIN32)
+            if ( errno == EINTR )
+                continue;
+#endif
+            return 1;
+        }
+
+        if(wakefd >= 0 && FD_ISSET (wakefd, &in_set))
+            _wakeup->drain();
+
+        if ( _processSession (&in_set, &out_set) )
+            return 1;
+    }
+
+    return 0;
+}
+
+void IrcConnection::_wakeupLoop()
+{
+    if(_reactorLoop)
+        _reactorLoop->wake(this);
+    else if(_wakeup)
+        _wakeup->signal();
+}
+
+void IrcConnection::tick(millis_t now)
+{
+    MutexHandle innerHandle(&_innerMutex);
+    if(_running || !_tryingToConnect || now < _nextConnectAttempt)
+        return;
+
+    // same as in run(), but without blocking the reactor while we wait
+    if(_reconectDelay > 0)
+    {
+        printf("Delaying reconnect for %d seconds.\n", _reconectDelay);
+        _nextConnectAttempt = now + (millis_t)_reconectDelay * 1000;
+        _reconectDelay = 0;
+        return;
+    }
+
+    if(_connectRetries == 0 && _openSession())
+    {
+        _tryingToConnect = false;
+        return;
+    }
+
+    const unsigned int max_retry_count = 10;
+    if ( _connectSession(_connectRetries) )
+    {
+        if(_connectRetries == max_retry_count)
+        {
+            printf("Giving up.\n\n");
+            _tryingToConnect = false;
+            _connectRetries = 0;
+        }
+        else
+        {
+            printf("Failed. Waiting 5 Sec. \n");
+            _nextConnectAttempt = now + 5000;
+            _connectRetries++;
+        }
+        return;
+    }
+
+    _connectRetries = 0;
+    _running = true;
+}
+
+int IrcConnection::addDescriptors(fd_set* in_set, fd_set* out_set, int* maxfd)
+{
+    MutexHandle innerHandle(&_innerMutex);
+    Return_MinusOne_Unless(_running && _session);
+    _outboundDeadline = _flushOutbound(getMilliseconds());
+    int retval = _addSessionDescriptors(in_set, out_set, maxfd);
+    innerHandle.release();
+    _notifySendBuffer();
+    return retval;
+}
+
+int IrcConnection::processDescriptors(fd_set* in_set, fd_set* out_set)
+{
+    // no _innerMutex here, the callbacks triggered from libirc need it
+    Return_MinusOne_Unless(isRunning() && _session);
+    if ( _processSession(in_set, out_set) == 0 )
+        return 0;
+
+    MutexHandle innerHandle(&_innerMutex);
+    // irc_process_select_descriptors also fails for sessions we quit ourselfes,
+    // only report the ones that went away unexpectedly
+    if(_running && _tryingToConnect)
+        printf ("Could not connect or I/O error: %s (Server: %s )\n", irc_strerror (irc_errno(_session)), _serverInfo.server);
+    _running = false;
+    _nextConnectAttempt = 0;
+    return -1;
+}
+
+int IrcConnection::_openSession()
+{
+    if(_session)
+    {
+        irc_destroy_session(_session);
+        _session = NULL;
+    }
+
+    // the mask may have changed since the last session
+    _setCallbacks();
+    _session = irc_create_session (&_callbacks);
+
+    if ( !_session )
+    {
+        printf ("Could not create IRC session\n");
+        return -1;
+    }
+
+    _sessionGeneration++;
+    irc_set_ctx (_session, this);
+
+    // If the port number is specified in the server string, use the port 0 so it gets parsed
+    if ( strchr( _serverInfo.server, ':' ) != 0 )
+        _port = 0;
+
+    // To handle the "SSL certificate verify failed" from command line we allow passing ## in front 
+    // of the server name, and in this case tell libircclient not to verify the cert
+    if ( _serverInfo.server[0] == '#' && _serverInfo.server[1] == '#' )
+    {
+        // Skip the first character as libircclient needs only one # for SSL support, i.e. #irc.freenode.net
+        _serverInfo.server++;
+        
+        irc_option_set( _session, LIBIRC_OPTION_SSL_NO_VERIFY );
+    }
+
+    // libirc can not hand us the data of ssl sessions
+    _nativeSession = _nativeInput && _serverInfo.server[0] != '#';
+    _socket = -1;
+    _inLength = 0;
+    _inSkipLine = false;
+    _motdReceived = false;
+    _currentNick = String(_serverInfo.nick);
+    _ownPrefix.clear();
+    // whatever the last session did not get out is meant for channels we aren't in anymore
+    for(unsigned int lane = 0; lane < IRC_LANE_COUNT; lane++)
+        _lanes[lane].clear();
+    _outboundDeadline = 0;
+    _modeBatcher.clear();
+    _sendQueue.clear();
+    _sendWriting = false;
+    _publishCaps(new IrcServerCaps());
+    _state.clear();
+    _applyCaseMapping();
+    return 0;
+}
+
+void IrcConnection::_publishCaps(IrcServerCaps* caps)
+{
+    // a 005 line that repeats what we know changes nothing for whoever compares snapshots
+    if(_caps->equals(*caps))
+    {
+        delete caps;
+        return;
+    }
+    IrcServerCapsHandle next(caps);
+    MutexHandle snapshotHandle(&_snapshotMutex);
+    _capsHandle.swap(next);
+    _caps = caps;
+    // the old one goes with next once its last reader lets go of it, not under the lock
+    snapshotHandle.release();
+}
+
+void IrcConnection::_applyCaseMapping()
+{
+    const IrcCaseMapping& mapping = _caps->getCaseMapping();
+    for(unsigned int lane = 0; lane < IRC_LANE_COUNT; lane++)
+        _lanes[lane].setCaseMapping(mapping);
+    _modeBatcher.setCaseMapping(mapping);
+    _state.setCaseMapping(mapping);
+}
+
+int IrcConnection::_connectSession(unsigned int attempt)
+{
+    if ( irc_connect (_session, _serverInfo.server, _port, 0, _serverInfo.nick, 0, 0) )
+    {
+        printf ("Try #%d : Could not connect: %s (Server: %s ) \n", attempt+1, irc_strerror (irc_errno(_session)), _serverInfo.server );
+        return -1;
+    }
+    printf("Success! We're connected.\n");
+
+    // right after irc_connect the session only waits for its socket to become writable,
+    // so that is the only descriptor it adds. DCC sockets join the sets later on
+    fd_set* scratch = irc_fd_alloc(irc_fd_capacity());
+    int maxfd = -1;
+    if(scratch)
+        irc_add_select_descriptors(_session, scratch, scratch, &maxfd);
+    irc_fd_free(scratch);
+    _socket = maxfd;
+    _nativeSession = _nativeSession && _socket >= 0;
+    return 0;
+}
+
+void IrcConnection::setNumericHandler(unsigned int numeric, NumericHandler handler)
+{
+    MutexHandle innerHandle(&_innerMutex);
+    Return_Void_Unless(numeric < IRC_NUMERIC_COUNT);
+    if(!_numericHandlers)
+    {
+        _numericHandlers = new NumericHandler[IRC_NUMERIC_COUNT];
+        for(unsigned int i = 0; i < IRC_NUMERIC_COUNT; i++)
+            _numericHandlers[i] = NULL;
+    }
+    _numericHandlers[numeric] = handler;
+}
+
+// the longest line irc_send_raw(...) takes into its empty 1024 byte buffer, without the line end
+#define IRC_LIBIRC_MAX_LINE 1021
+
+bool IrcConnection::_fitsLine(size_t length)
+{
+    // LINELEN, and libirc's buffer unless we write ourselfes
+    return length <= _caps->getMessageLength() && (_nativeSession || length <= IRC_LIBIRC_MAX_LINE);
+}
+
+int IrcConnection::_queueLine(IrcLane lane, const String& target, const String& line)
+{
+    // the server would cut a longer line, a line break would end the command early
+    Unless(_fitsLine(line.size()) && line.find_first_of("\r\n") == String::npos)
+        return -1;
+    _lanes[lane].push(target, line, getMilliseconds());
+    _wakeupLoop();
+    return 0;
+}
+
+// how much the lanes hand to the socket queue of a native session at once. Kept small,
+// lines released later can only overtake what is still in the lanes
+#define IRC_SEND_QUEUE_BATCH 4096
+
+millis_t IrcConnection::_flushOutbound(millis_t now)
+{
+    Return_Zero_Unless(_session);
+    // the mode changes that are due or make a full line join the control lane first
+    millis_t deadline = _modeBatcher.flush(now, _caps->getModesMax(), _textLimit(0), &_lanes[IRC_LANE_CONTROL]);
+    for(unsigned int lane = 0; lane < IRC_LANE_COUNT; lane++)
+    {
+        IrcFloodControl& queue = _lanes[lane];
+        const IrcOutboundLine* line;
+        while((line = queue.front(now)))
+        {
+            if(_nativeSession)
+            {
+                // the next batch once the socket took this one
+                if(_sendQueue.size() >= IRC_SEND_QUEUE_BATCH)
+                    return 0;
+                IrcOutboundLine out;
+                queue.pop(now, &out);
+                _sendQueue.push(out);
+                continue;
+            }
+            // fails while we are still connecting or libirc's buffer is full, the line stays
+            // queued and the next round after libirc wrote its buffer tries again. The lower
+            // lanes wait as well, so they can't take the room a higher one needs
+            IrcStringView body = line->body();
+            // _queueLine(...) and _queueText(...) refuse longer lines, see _fitsLine(...). Should
+            // one get here anyway it would hold up every lane behind it
+            size_t length = line->head.size() + body.size + line->tail.size;
+            if(length > IRC_LIBIRC_MAX_LINE)
+            {
+                #ifdef IRC_CONNECTION_DEBUG
+                printf("Dropped a line of %u bytes, it does not fit into libirc's buffer\n", (unsigned int)length);
+                #endif
+                queue.drop();
+                continue;
+            }
+            if(irc_send_raw(_session, "%s%.*s%.*s", line->head.c_str(), (int)body.size, body.data, (int)line->tail.size, line->tail.data))
+                return 0;
+            queue.pop(now);
+        }
+        millis_t release = queue.nextRelease(now);
+        if(release && (!deadline || release < deadline))
+            deadline = release;
+    }
+    return deadline;
+}
+
+int IrcConnection::_addSessionDescriptors(fd_set* in_set, fd_set* out_set, int* maxfd)
+{
+    int retval = irc_add_select_descriptors(_session, in_set, out_set, maxfd);
+    // libirc still writes what it queued itself, i.e. the registration, and wants the socket
+    // for the connect as well. Ours waits until then, so the lines never get mixed up
+    _sendWriting = retval == 0 && _nativeSession && !_sendQueue.empty() && !irc_fd_isset(out_set, _socket);
+    if(_sendWriting)
+    {
+        irc_fd_set(out_set, _socket);
+        if(_socket > *maxfd)
+            *maxfd = _socket;
+    }
+    return retval;
+}
+
+size_t IrcConnection::_sendBufferSize()
+{
+    size_t size = _sendQueue.size();
+    for(unsigned int lane = 0; lane < IRC_LANE_COUNT; lane++)
+        size += _lanes[lane].pendingBytes();
+    return size;
+}
+
+void IrcConnection::_notifySendBuffer()
+{
+    MutexHandle innerHandle(&_innerMutex);
+    size_t pending = _sendBufferSize();
+    bool high = _sendBufferHigh;
+    if(!high && _sendBufferHighMark && pending > _sendBufferHighMark)
+        high = true;
+    // turning the watermarks off counts as drained as well
+    else if(high && (pending <= _sendBufferLowMark || !_sendBufferHighMark))
+        high = false;
+    Return_Void_Unless(high != _sendBufferHigh);
+    _sendBufferHigh = high;
+    innerHandle.release();
+
+    // only ever called from the loop driving us, so the calls can't overtake each other
+    MutexHandle connectionMutex(&_mutex);
+    if(high)
+        on_send_buffer_high(pending);
+    else
+        on_send_buffer_drained(pending);
+}
+
+int IrcConnection::_queueBroadcast(const char* command, IrcCommand commandId, const StringVector& targets, const IrcPayload& text)
+{
+    const unsigned int targetMax = _caps->getTargetMax(commandId);
+    // "COMMAND " and " :", the targets may take up the line as long as there is room left
+    // for the text, long texts are split anyway so they only get to keep half of it.
+    // Each line is queued under its target list, see broadcastMessage(...) about the order
+    const size_t fixedLength = strlen(command) + 1 + 2;
+    const size_t lineLimit = _textLimit(fixedLength);
+    const size_t textRoom = text.size() < lineLimit / 2 ? text.size() : lineLimit / 2;
+    String list;
+    unsigned int count = 0;
+    int retval = 0;
+    for(size_t i = 0; i < targets.size(); i++)
+    {
+        const String& target = targets[i];
+        if(target.empty())
+            continue;
+
+        // full or the next target would leave too little room for the text
+        if(count && (count == targetMax || list.size() + 1 + target.size() + textRoom > lineLimit))
+        {
+            if(_queueText(IRC_LANE_CHAT, command, list, text))
+                retval = -1;
+            list.clear();
+            count = 0;
+        }
+        if(count)
+            list.append(",");
+        list.append(target);
+        count++;
+    }
+    if(count && _queueText(IRC_LANE_CHAT, command, list, text))
+        retval = -1;
+    return retval;
+}
+
+// the length of the first piece of text that fits into limit bytes, cut after the last
+// word that fits or, if there is none, before the first utf-8 character that does not fit
+static size_t irc_connection_split(const char* text, size_t size, size_t limit)
+{
+    if(size <= limit)
+        return size;
+    size_t cut = limit;
+    // continuation bytes are 10xxxxxx
+    while(cut > 0 && (text[cut] & 0xC0) == 0x80)
+        cut--;
+    // don't give up more than half the line for a word boundary
+    for(size_t space = cut; space > limit / 2; space--)
+    {
+        if(text[space] == ' ')
+            return space;
+    }
+    return cut ? cut : limit;
+}
+
+size_t IrcConnection::_textLimit(size_t headerLength)
+{
+    // the server relays ":nick!user@host " in front of our line. Until we know our prefix
+    // we assume the longest user name and host name the common servers allow
+    size_t prefixLength = _ownPrefix.size() ? _ownPrefix.size() : _currentNick.size() + 1 + 11 + 1 + 63;
+    size_t used = 1 + prefixLength + 1 + headerLength;
+    // LINELEN, but never more than a line builder holds
+    size_t length = _caps->getMessageLength() < IRC_MAX_MESSAGE_LENGTH ? _caps->getMessageLength() : IRC_MAX_MESSAGE_LENGTH;
+    // at least a few chars per line, whatever the server says
+    return used + 16 < length ? length - used : 16;
+}
+
+int IrcConnection::_queueText(IrcLane lane, const char* command, const String& target, const IrcPayload& text, const char* ctcp/* = NULL*/)
+{
+    // "COMMAND target :" ["\x01" ctcp " "] text ["\x01"], only the head is built per line
+    String head(command);
+    head.append(" ").append(target).append(" :");
+    IrcStringView tail;
+    if(ctcp)
+    {
+        head.append("\x01").append(ctcp).append(" ");
+        tail = IrcStringView("\x01", 1);
+    }
+    const size_t limit = _textLimit(head.size() + tail.size);
+    // a target so long that not even the shortest piece of text fits next to it
+    Unless(_fitsLine(head.size() + limit + tail.size) && target.find_first_of("\r\n") == String::npos)
+        return -1;
+
+    const millis_t now = getMilliseconds();
+    const char* begin = text.data();
+    const char* p = begin;
+    const char* end = p + text.size();
+    do
+    {
+        // line breaks would end the command early, they start a new message instead
+        const char* lineEnd = p;
+        while(lineEnd < end && *lineEnd != '\r' && *lineEnd != '\n')
+            lineEnd++;
+        size_t length = irc_connection_split(p, lineEnd - p, limit);
+
+        // empty lines are dropped, but an empty text is still sent as one
+        if(length || text.empty())
+        {
+            IrcOutboundLine line;
+            line.head = head;
+            line.payload = text;
+            line.offset = p - begin;
+            line.size = length;
+            line.tail = tail;
+            _lanes[lane].push(target, line, now);
+        }
+
+        p += length;
+        if(p < end && (*p == ' ' || *p == '\r' || *p == '\n'))
+            p++;
+    }
+    while(p < end);
+
+    _wakeupLoop();
+    return 0;
+}
+
+void IrcConnection::_trackMessage(const IrcMessageView& message)
+{
+    MutexHandle innerHandle(&_innerMutex);
+    if(_trackedMask & IRC_EVENT_MASK_STATE)
+        _trackState(message);
+
+    switch(message.type)
+    {
+    case IRC_EVENT_NUMERIC:
+        if(message.numeric == 1 && message.count > 0)
+        {
+            // "Welcome to the Internet Relay Network nick!user@host", if the server tells
+            _currentNick = message.params[0].toString();
+            IrcStringView welcome = message.param(message.count - 1);
+            size_t word = welcome.size;
+            while(word > 0 && welcome[word - 1] != ' ')
+                word--;
+            IrcStringView last(welcome.data + word, welcome.size - word);
+            IrcPrefix prefix(last);
+            if(prefix.host.size && prefix.user.size && _isOwnNick(prefix.nick))
+                _ownPrefix = last.toString();
+        }
+        else if(message.numeric == 5) // RPL_ISUPPORT, libirc still calls it RPL_BOUNCE
+        {
+            // applied to a copy, whoever holds the current snapshot keeps it as it is
+            IrcServerCaps* caps = new IrcServerCaps(*_caps);
+            caps->parseIsupport(message);
+            _publishCaps(caps);
+            _applyCaseMapping();
+        }
+        break;
+
+    case IRC_EVENT_JOIN:
+        // the echo of our own join always carries our full prefix
+        if(message.prefix.host.size && _isOwnNick(message.prefix.nick))
+            _ownPrefix = message.origin.toString();
+        break;
+
+    case IRC_EVENT_NICK:
+        if(message.count > 0 && _isOwnNick(message.prefix.nick))
+        {
+            _currentNick = message.params[0].toString();
+            if(_ownPrefix.size())
+                _ownPrefix.replace(0, message.prefix.nick.size, _currentNick);
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+void IrcConnection::_trackState(const IrcMessageView& message)
+{
+    switch(message.type)
+    {
+    case IRC_EVENT_JOIN:
+        _state.onJoin(message.param(0), message.prefix, _isOwnNick(message.prefix.nick));
+        break;
+    case IRC_EVENT_PART:
+        _state.onPart(message.param(0), message.prefix.nick, _isOwnNick(message.prefix.nick));
+        break;
+    case IRC_EVENT_KICK:
+        _state.onPart(message.param(0), message.param(1), _isOwnNick(message.param(1)));
+        break;
+    case IRC_EVENT_QUIT:
+        _state.onQuit(message.prefix.nick);
+        break;
+    case IRC_EVENT_NICK:
+        _state.onNick(message.prefix.nick, message.param(0));
+        break;
+    case IRC_EVENT_MODE:
+        _state.onMode(message, *_caps);
+        break;
+    case IRC_EVENT_NUMERIC:
+        // RPL_NAMREPLY, "<our nick> = #chan :@op +voiced nick"
+        if(message.numeric == 353 && message.count >= 4)
+            _state.onNames(message.params[2], message.params[3], *_caps);
+        break;
+    default:
+        break;
+    }
+}
+
+char IrcConnection::getMemberPrefix(const String channel, const String nick)
+{
+    MutexHandle innerHandle(&_innerMutex);
+    int modes = _state.getMemberModes(IrcStringView(channel.data(), channel.size()), IrcStringView(nick.data(), nick.size()));
+    Return_Zero_Unless(modes > 0);
+    unsigned int prefix = 0;
+    while(!(modes & (1 << prefix)))
+        prefix++;
+    return prefix < _caps->getPrefixCount() ? _caps->getPrefixChar(prefix) : 0;
+}
+
+int IrcConnection::getChannelMembers(const String channel, StringVector* nicks)
+{
+    MutexHandle innerHandle(&_innerMutex);
+    return _state.getChannelMembers(IrcStringView(channel.data(), channel.size()), nicks, _caps) ? 0 : -1;
+}
+
+IrcStateSnapshot IrcConnection::getStateSnapshot()
+{
+    MutexHandle snapshotHandle(&_snapshotMutex);
+    if(_stateSnapshots)
+        return _stateSnapshot;
+    snapshotHandle.release();
+
+    // the first call, the loop didn't copy anything so far
+    MutexHandle innerHandle(&_innerMutex);
+    snapshotHandle.aquire(&_snapshotMutex);
+    if(!_stateSnapshots)
+    {
+        _state.snapshot(&_stateSnapshot, *_caps);
+        _stateSnapshots = true;
+    }
+    return _stateSnapshot;
+}
+
+void IrcConnection::_publishState()
+{
+    MutexHandle innerHandle(&_innerMutex);
+    // _stateSnapshots only changes with both mutexes held
+    Return_Void_Unless(_stateSnapshots && _state.hasChanged());
+    IrcStateSnapshot next;
+    _state.snapshot(&next, *_caps);
+    MutexHandle snapshotHandle(&_snapshotMutex);
+    _stateSnapshot.swap(next);
+    // the old one goes with next once its last reader lets go of it, not under the lock
+    snapshotHandle.release();
+}
+
+int IrcConnection::getUserChannels(const String nick, StringVector* channels)
+{
+    MutexHandle innerHandle(&_innerMutex);
+    return _state.getUserChannels(IrcStringView(nick.data(), nick.size()), channels) ? 0 : -1;
+}
+
+int IrcConnection::getNamesInChannel(const String channel, String* channelNames)
+{
+    MutexHandle innerHandle(&_innerMutex);
+    Return_MinusOne_Unless(_running);
+
+    StringVector names;
+    if(_state.getChannelMembers(IrcStringView(channel.data(), channel.size()), &names, _caps))
+    {
+        channelNames->clear();
+        for(size_t i = 0; i < names.size(); i++)
+        {
+            if(i)
+                channelNames->push_back(' ');
+            channelNames->append(names[i]);
+        }
+        return 0;
+    }
+
+    // the names come in as numerics, all we can hand back is the channel
+    (*channelNames) = channel;
+    return _queueLine(IRC_LANE_BULK, channel, String("NAMES ").append(channel));
+}
+
 void IrcConnection::resetSession()
 {
     MutexHandle innerHandle(&_innerMutex);
@@ -364,26 +1022,290 @@ void IrcConnection::resetSession()
 void IrcConnection::_setCallbacks()
 {
     memset (&_callbacks, 0, sizeof(_callbacks));
+    _viewDispatcher = irc_connection_dispatch_view;
     
-    _callbacks.event_connect        = irc_connection_event_connect;
-    _callbacks.event_nick           = irc_connection_event_nick;
-    _callbacks.event_quit           = irc_connection_event_quit;
-    _callbacks.event_join           = irc_connection_event_join;
-    _callbacks.event_part           = irc_connection_event_part;
-    _callbacks.event_mode           = irc_connection_event_mode;
-    _callbacks.event_umode          = irc_connection_event_umode;
-    _callbacks.event_topic          = irc_connection_event_topic;
-    _callbacks.event_kick           = irc_connection_event_kick;
-    _callbacks.event_channel        = irc_connection_event_channel;
-    _callbacks.event_privmsg        = irc_connection_event_privmsg;
-    _callbacks.event_notice         = irc_connection_event_notice;
-    _callbacks.event_channel_notice = irc_connection_event_channel_notice;
-    _callbacks.event_invite         = irc_connection_event_invite;
-    _callbacks.event_ctcp_req       = irc_connection_event_ctcp_req;
-    _callbacks.event_ctcp_rep       = irc_connection_event_ctcp_rep;
-    _callbacks.event_ctcp_action    = irc_connection_event_ctcp_action;
-    _callbacks.event_unknown        = irc_connection_event_unknown;
-    _callbacks.event_numeric        = irc_connection_event_numeric;
+    // unset callbacks are skipped by libirc, so masked events cost nothing but the parsing.
+    // The ones we track ourselves are always set, dispatchMessage(...) filters them
+    _sessionEventMask = _eventMask;
+    _trackedMask = IRC_EVENT_MASK_TRACKED;
+    if(_stateTracking)
+        _trackedMask |= IRC_EVENT_MASK_STATE;
+    const unsigned int callbackMask = _sessionEventMask | _trackedMask;
+#define IRC_CONNECTION_SET_CALLBACK(member, name, type) \
+    if(callbackMask & IRC_EVENT_BIT(type)) \
+        _callbacks.member = irc_connection_event_##name;
+
+    IRC_CONNECTION_SET_CALLBACK(event_connect,          connect,        IRC_EVENT_CONNECT)
+    IRC_CONNECTION_SET_CALLBACK(event_nick,             nick,           IRC_EVENT_NICK)
+    IRC_CONNECTION_SET_CALLBACK(event_quit,             quit,           IRC_EVENT_QUIT)
+    IRC_CONNECTION_SET_CALLBACK(event_join,             join,           IRC_EVENT_JOIN)
+    IRC_CONNECTION_SET_CALLBACK(event_part,             part,           IRC_EVENT_PART)
+    IRC_CONNECTION_SET_CALLBACK(event_mode,             mode,           IRC_EVENT_MODE)
+    IRC_CONNECTION_SET_CALLBACK(event_umode,            umode,          IRC_EVENT_UMODE)
+    IRC_CONNECTION_SET_CALLBACK(event_topic,            topic,          IRC_EVENT_TOPIC)
+    IRC_CONNECTION_SET_CALLBACK(event_kick,             kick,           IRC_EVENT_KICK)
+    IRC_CONNECTION_SET_CALLBACK(event_channel,          channel,        IRC_EVENT_CHANNEL)
+    IRC_CONNECTION_SET_CALLBACK(event_privmsg,          privmsg,        IRC_EVENT_PRIVMSG)
+    IRC_CONNECTION_SET_CALLBACK(event_notice,           notice,         IRC_EVENT_NOTICE)
+    IRC_CONNECTION_SET_CALLBACK(event_channel_notice,   channel_notice, IRC_EVENT_CHANNEL_NOTICE)
+    IRC_CONNECTION_SET_CALLBACK(event_invite,           invite,         IRC_EVENT_INVITE)
+    IRC_CONNECTION_SET_CALLBACK(event_ctcp_req,         ctcp_req,       IRC_EVENT_CTCP_REQ)
+    IRC_CONNECTION_SET_CALLBACK(event_ctcp_rep,         ctcp_rep,       IRC_EVENT_CTCP_REP)
+    IRC_CONNECTION_SET_CALLBACK(event_ctcp_action,      ctcp_action,    IRC_EVENT_CTCP_ACTION)
+    IRC_CONNECTION_SET_CALLBACK(event_unknown,          unknown,        IRC_EVENT_UNKNOWN)
+    IRC_CONNECTION_SET_CALLBACK(event_numeric,          numeric,        IRC_EVENT_NUMERIC)
+#undef IRC_CONNECTION_SET_CALLBACK
+
     _callbacks.event_dcc_chat_req   = irc_connection_event_dcc_chat_req;
     _callbacks.event_dcc_send_req   = irc_connection_event_dcc_send_req;
-}
\ No newline at end of file
+}
+// size of the receive buffer of native sessions, a few of the longest lines we accept
+#define IRC_NATIVE_INPUT_SIZE (2 * (IRC_MAX_LINE_LENGTH + 1))
+
+int IrcConnection::_processSession(fd_set* in_set, fd_set* out_set)
+{
+    if(_nativeSession && irc_fd_isset(in_set, _socket))
+    {
+        // libirc must not read the socket itself, it still writes and keeps track of the state
+        irc_fd_clear(in_set, _socket);
+        if(_readNativeInput())
+        {
+            irc_disconnect(_session);
+            return 1;
+        }
+    }
+    if(_nativeSession && irc_fd_isset(out_set, _socket))
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        // libirc has nothing to write if we asked for the socket, see _addSessionDescriptors(...)
+        if(_sendWriting)
+        {
+            irc_fd_clear(out_set, _socket);
+            _sendWriting = false;
+            if(_sendQueue.write(_socket))
+            {
+                irc_disconnect(_session);
+                return 1;
+            }
+        }
+    }
+    int retval = irc_process_select_descriptors(_session, in_set, out_set);
+    _publishState();
+    return retval;
+}
+
+int IrcConnection::_readNativeInput()
+{
+    if(!_inBuffer)
+        _inBuffer = (char*) malloc(IRC_NATIVE_INPUT_SIZE);
+    Return_MinusOne_Unless(_inBuffer);
+
+    int length = recv(_socket, _inBuffer + _inLength, (int)(IRC_NATIVE_INPUT_SIZE - _inLength), 0);
+    if(length == 0)
+        return -1;
+    if(length < 0)
+    {
+#if defined (WIN32)
+        int error = WSAGetLastError();
+        return (error == WSAEWOULDBLOCK || error == WSAEINTR) ? 0 : -1;
+#else
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+#endif
+    }
+    _inLength += length;
+
+    const char* begin = _inBuffer;
+    const char* end = _inBuffer + _inLength;
+    while(begin < end)
+    {
+        const char* lineEnd = IrcParser::findLineEnd(begin, end);
+        if(lineEnd == end)
+            break;
+        IrcParsedLine line;
+        if(!_inSkipLine && IrcParser::parseLine(begin, lineEnd, &line) == 0)
+            _onNativeLine(line);
+        _inSkipLine = false;
+        begin = lineEnd + 1;
+    }
+
+    _inLength = end - begin;
+    if(_inLength == IRC_NATIVE_INPUT_SIZE)
+    {
+        // a line longer than anything we accept, drop it up to its end
+        _inLength = 0;
+        _inSkipLine = true;
+    }
+    else if(_inLength && begin != _inBuffer)
+        memmove(_inBuffer, begin, _inLength);
+    return 0;
+}
+
+
+void IrcConnection::_onNativeLine(const IrcParsedLine& line)
+{
+    IrcMessageView message;
+    message.event = line.command;
+    message.command = line.commandId;
+    message.numeric = line.numeric;
+    message.count = line.count;
+    for(unsigned int i = 0; i < line.count; i++)
+        message.params[i] = line.params[i];
+
+    message.origin = line.prefix;
+    message.prefix = IrcPrefix(line.prefix);
+
+    switch(line.commandId)
+    {
+    case IRC_COMMAND_NUMERIC:
+        // the first end of (or missing) motd completes the registration
+        if((line.numeric == 376 || line.numeric == 422) && !_motdReceived)
+        {
+            _motdReceived = true;
+            message.type = IRC_EVENT_CONNECT;
+            message.event = IrcStringView("CONNECT");
+            _dispatchNative(message);
+            message.event = line.command;
+        }
+        message.type = IRC_EVENT_NUMERIC;
+        break;
+
+    case IRC_COMMAND_PING:
+        if(line.count > 0)
+        {
+            MutexHandle innerHandle(&_innerMutex);
+            _queueLine(IRC_LANE_KEEPALIVE, String(), String("PONG ").append(line.params[0].data, line.params[0].size));
+        }
+        return;
+
+    case IRC_COMMAND_PRIVMSG:
+    case IRC_COMMAND_NOTICE:
+    {
+        Return_Void_Unless(line.count > 1);
+        bool privmsg = line.commandId == IRC_COMMAND_PRIVMSG;
+        const IrcStringView& text = line.params[1];
+        if(text.size >= 2 && text[0] == 0x01 && text[text.size - 1] == 0x01)
+        {
+            IrcStringView ctcp(text.data + 1, text.size - 2);
+            if(!privmsg)
+            {
+                message.type = IRC_EVENT_CTCP_REP;
+                message.event = IrcStringView("CTCP");
+                message.params[0] = ctcp;
+                message.count = 1;
+            }
+            else if(ctcp.startsWith("DCC "))
+            {
+                // dcc is left to libirc, see setNativeInput(...)
+                return;
+            }
+            else if(ctcp.startsWith("ACTION "))
+            {
+                message.type = IRC_EVENT_CTCP_ACTION;
+                message.event = IrcStringView("ACTION");
+                message.params[1] = IrcStringView(ctcp.data + 7, ctcp.size - 7);
+                message.count = 2;
+            }
+            else
+            {
+                message.type = IRC_EVENT_CTCP_REQ;
+                message.event = IrcStringView("CTCP");
+                message.params[0] = ctcp;
+                message.count = 1;
+                Unless(_sessionEventMask & IRC_EVENT_BIT(IRC_EVENT_CTCP_REQ))
+                {
+                    _replyCtcp(message.prefix.nick, ctcp);
+                    return;
+                }
+            }
+        }
+        else if(_isOwnNick(line.params[0]))
+        {
+            message.type = privmsg ? IRC_EVENT_PRIVMSG : IRC_EVENT_NOTICE;
+        }
+        else
+        {
+            message.type = privmsg ? IRC_EVENT_CHANNEL : IRC_EVENT_CHANNEL_NOTICE;
+            if(privmsg)
+                message.event = IrcStringView("CHANNEL");
+        }
+        break;
+    }
+
+    case IRC_COMMAND_JOIN:      message.type = IRC_EVENT_JOIN;      break;
+    case IRC_COMMAND_PART:      message.type = IRC_EVENT_PART;      break;
+    case IRC_COMMAND_QUIT:      message.type = IRC_EVENT_QUIT;      break;
+    case IRC_COMMAND_TOPIC:     message.type = IRC_EVENT_TOPIC;     break;
+    case IRC_COMMAND_KICK:      message.type = IRC_EVENT_KICK;      break;
+    case IRC_COMMAND_INVITE:    message.type = IRC_EVENT_INVITE;    break;
+
+    case IRC_COMMAND_NICK:
+        message.type = IRC_EVENT_NICK;
+        break;
+
+    case IRC_COMMAND_MODE:
+        if(line.count > 0 && _isOwnNick(line.params[0]))
+        {
+            message.type = IRC_EVENT_UMODE;
+            message.params[0] = message.param(1);
+            message.count = line.count > 1 ? 1 : 0;
+        }
+        else
+            message.type = IRC_EVENT_MODE;
+        break;
+
+    case IRC_COMMAND_KILL:
+        return; // not all servers send it, libirc ignores it as well
+
+    default:
+        message.type = IRC_EVENT_UNKNOWN;
+        break;
+    }
+
+    _dispatchNative(message);
+}
+
+void IrcConnection::_dispatchNative(const IrcMessageView& message)
+{
+    // drop what nobody wants before taking the lock
+    Return_Void_Unless(wantsMessage(message));
+    MutexHandle connectionMutex(&_mutex);
+    dispatchMessage(message);
+}
+
+void IrcConnection::_replyCtcp(const IrcStringView& nick, const IrcStringView& request)
+{
+    // what libirc answers for bots that do not handle ctcp requests themselves, so it makes
+    // no difference whether native input is on. They go through the bulk lane, so flooding
+    // us with requests does not flood the server
+    char text[256];
+    IrcStringView reply(text, 0);
+    if(request.startsWith("PING"))
+        reply = request;
+    else if(request.equals("VERSION"))
+    {
+        unsigned int high, low;
+        irc_get_version(&high, &low);
+        sprintf(text, "VERSION libirc by Georgy Yunaev ver.%d.%d", high, low);
+        reply = IrcStringView(text);
+    }
+    else if(request.equals("FINGER"))
+    {
+        // we never give libirc a user or real name
+        reply = IrcStringView("FINGER nobody (noname) Idle 0 seconds");
+    }
+    else if(request.equals("TIME"))
+    {
+        time_t now = time(0);
+        struct tm local;
+        #if defined (WIN32)
+        localtime_s(&local, &now);
+        #else
+        localtime_r(&now, &local);
+        #endif
+        strftime(text, sizeof(text), "%a %b %d %H:%M:%S %Z %Y", &local);
+        reply = IrcStringView(text);
+    }
+    else
+        return;
+    (IrcLineBuilder(*this, "NOTICE", String(nick.data, nick.size), IRC_LANE_BULK) << '\x01' << reply << '\x01').send();
+}
@@ -8,6 +8,16 @@
 #include <util/threadhelper.h>
 #include <vector>
 #include <util/util.h>
+#include <util/wakeupChannel.h>
+#include <irc/ircReactor.h>
+#include <irc/ircMessage.h>
+#include <irc/ircParser.h>
+#include <irc/ircNumerics.h>
+#include <irc/ircFloodControl.h>
+#include <irc/ircSendQueue.h>
+#include <irc/ircModeBatcher.h>
+#include <irc/ircServerCaps.h>
+#include <irc/ircStateTracker.h>
 
 //ircConnection.h
 //Author: Simon Wittenberg
@@ -19,6 +29,10 @@ typedef std::vector<String> StringVector;
 
 #define NullString String("")
 
+// default watermarks of the send buffer, see setSendBufferWatermarks(...)
+#define IRC_SEND_BUFFER_HIGH    (64 * 1024)
+#define IRC_SEND_BUFFER_LOW     (16 * 1024)
+
 struct IRCServerInfo
 {
     IRCServerInfo()
@@ -34,10 +48,66 @@ struct IRCServerInfo
 
 class IrcConnection;
 
+// the command libirc raised an event for, only unknown events still need a lookup
+inline IrcCommand irc_connection_event_command(IrcEventType type, const IrcStringView& event)
+{
+    switch(type)
+    {
+    case IRC_EVENT_CONNECT:
+    case IRC_EVENT_NUMERIC:         return IRC_COMMAND_NUMERIC;
+    case IRC_EVENT_NICK:            return IRC_COMMAND_NICK;
+    case IRC_EVENT_QUIT:            return IRC_COMMAND_QUIT;
+    case IRC_EVENT_JOIN:            return IRC_COMMAND_JOIN;
+    case IRC_EVENT_PART:            return IRC_COMMAND_PART;
+    case IRC_EVENT_MODE:
+    case IRC_EVENT_UMODE:           return IRC_COMMAND_MODE;
+    case IRC_EVENT_TOPIC:           return IRC_COMMAND_TOPIC;
+    case IRC_EVENT_KICK:            return IRC_COMMAND_KICK;
+    case IRC_EVENT_CHANNEL:
+    case IRC_EVENT_PRIVMSG:
+    case IRC_EVENT_CTCP_REQ:
+    case IRC_EVENT_CTCP_ACTION:     return IRC_COMMAND_PRIVMSG;
+    case IRC_EVENT_NOTICE:
+    case IRC_EVENT_CHANNEL_NOTICE:
+    case IRC_EVENT_CTCP_REP:        return IRC_COMMAND_NOTICE;
+    case IRC_EVENT_INVITE:          return IRC_COMMAND_INVITE;
+    default:                        return IrcParser::lookupCommand(event);
+    }
+}
+
+// fills message with the data of a libirc event callback, shared by the dispatch of
+// IrcConnection and BasicIrcConnection<...>. Nothing is copied, the views point into
+// the strings libirc hands us.
+// eventText must hold 4 chars for numerics, their text form is written into it.
+inline void irc_connection_make_view(IrcMessageView& message, IrcEventType type, unsigned int numeric, const char * event, char * eventText, const char * origin, const char ** params, unsigned int count)
+{
+    message.type = type;
+    message.numeric = numeric;
+    if(type == IRC_EVENT_NUMERIC)
+    {
+        // numerics are always three digits
+        eventText[0] = (char)('0' + (numeric / 100) % 10);
+        eventText[1] = (char)('0' + (numeric / 10) % 10);
+        eventText[2] = (char)('0' + numeric % 10);
+        eventText[3] = 0;
+        event = eventText;
+    }
+    message.event = IrcStringView(event);
+    message.command = irc_connection_event_command(type, message.event);
+    message.origin = IrcStringView(origin);
+    message.prefix = IrcPrefix(message.origin);
+    message.count = count < IRC_MAX_PARAMS ? count : IRC_MAX_PARAMS;
+    for(unsigned int i = 0; i < message.count; i++)
+    {
+        message.params[i] = IrcStringView(params[i]);
+    }
+}
+
 class IrcConnection
 {
 public:
     IrcConnection();
+    virtual ~IrcConnection();
 
     /********************************************************************/
     //                  Control Methods                                 //
@@ -62,6 +132,31 @@ public:
     // this is the method that is run in the thread.
     void run();
 
+    // Start the connection inside of an IrcReactor instead of spawning a thread for it
+    // and optionally supply a new ServerInfo, if none was set earlier.
+    // An attached connection has to be detach()ed before it is deleted.
+    int attachTo(IrcReactor* reactor, IRCServerInfo* target = NULL);
+
+    // takes the connection out of its IrcReactor, once this returns the reactor won't call it anymore.
+    // Required before deleting an attached connection: ~IrcConnection() runs after the members of
+    // derived classes are gone, so the owner or the destructor of the most derived class calls this.
+    // Not from the connection's own callbacks, the reactor thread can't wait for itself
+    void detach();
+
+    // returns the reactor loop driving this connection or NULL if it runs in its own thread
+    IrcReactorLoop* getReactorLoop(){ MutexHandle innerHandle(&_innerMutex); return _reactorLoop; };
+
+    // internal functions only do not use directly!
+    // these are the methods the IrcReactor uses to drive the connection,
+    // tick(...) takes care of (re)connecting, the others wrap irc_add/process_select_descriptors.
+    void tick(millis_t now);
+    int addDescriptors(fd_set* in_set, fd_set* out_set, int* maxfd);
+    int processDescriptors(fd_set* in_set, fd_set* out_set);
+    // changes whenever a new session (and thus a new socket) is created
+    unsigned int getSessionGeneration(){ MutexHandle innerHandle(&_innerMutex); return _sessionGeneration; };
+    // the socket to the server, -1 while there is none
+    int getSocket(){ MutexHandle innerHandle(&_innerMutex); return _socket; };
+
     // stop the connection
     void stop(){quit("I was told to");};
     
@@ -80,6 +175,196 @@ public:
     // set the time in seconds that this object should wait before attempting a reconnect when being disconnected 
     void setReconnectDelay(unsigned int sec){MutexHandle innerHandle(&_innerMutex); _reconectDelay = sec; };
 
+    // sets the events this object wants to receive, as IRC_EVENT_BIT(...)s or'ed together.
+    // Events outside of the mask are not even handed to us by libirc, so neither on_event(...)
+    // nor the on_*(...) methods are called for them, unless the channel state needs them (see
+    // setStateTracking(...)), then they are only not passed on. Defaults to IRC_EVENT_MASK_ALL.
+    // Takes effect with the next (re)connect, so set it before calling start(). That holds
+    // for native input as well.
+    // Note: without IRC_EVENT_CTCP_REQ libirc answers VERSION, PING and TIME requests itself.
+    void setEventMask(unsigned int mask){MutexHandle innerHandle(&_innerMutex); _eventMask = mask | IRC_EVENT_MASK_REQUIRED; };
+    unsigned int getEventMask(){MutexHandle innerHandle(&_innerMutex); return _eventMask; };
+
+    // whether received data is parsed by IrcParser instead of libirc, on by default.
+    // Only plain connections are read natively, ssl connections always use libirc.
+    // Note: dcc requests are only delivered by libirc, turn this off if you need them.
+    // Takes effect with the next (re)connect, so set it before calling start().
+    void setNativeInput(bool enable){MutexHandle innerHandle(&_innerMutex); _nativeInput = enable; };
+    bool getNativeInput(){MutexHandle innerHandle(&_innerMutex); return _nativeInput; };
+
+    // whether we keep track of who is in the channels we are in, on by default, see
+    // isOnChannel(...) and ircStateTracker.h. Costs the parsing of JOIN, PART, QUIT, KICK,
+    // NICK and MODE even if they aren't in the event mask.
+    // Takes effect with the next (re)connect, so set it before calling start().
+    void setStateTracking(bool enable){MutexHandle innerHandle(&_innerMutex); _stateTracking = enable; };
+    bool getStateTracking(){MutexHandle innerHandle(&_innerMutex); return _stateTracking; };
+
+    // whether nick is in channel. Answered from what we saw since we joined it, without asking
+    // the server, so always false for channels we aren't in or with state tracking turned off
+    bool isOnChannel(const String channel, const String nick)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        return _state.isOnChannel(IrcStringView(channel.data(), channel.size()), IrcStringView(nick.data(), nick.size()));
+    };
+
+    // the highest prefix of nick in channel, e.g. '@', 0 if it has none or isn't in channel
+    char getMemberPrefix(const String channel, const String nick);
+
+    // how many are in channel, 0 if we aren't in it
+    size_t getChannelSize(const String channel)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        return _state.getChannelSize(IrcStringView(channel.data(), channel.size()));
+    };
+
+    // int IrCConnection :: getChannelMembers(...)
+    //
+    // lists who is in a channel we are in, from the channel state
+    // params:
+    // String channel       (in)   - the name of the channel
+    // StringVector* nicks  (out)  - the nicks, with their highest prefix in front, e.g. "@nick"
+    // return:          0 on success, -1 if we aren't in channel or don't track it
+    int getChannelMembers(const String channel, StringVector* nicks);
+
+    // int IrCConnection :: getUserChannels(...)
+    //
+    // lists the channels we share with a user, from the channel state
+    // params:
+    // String nick              (in)   - the nick
+    // StringVector* channels   (out)  - the channels
+    // return:          0 on success, -1 if we don't share any
+    int getUserChannels(const String nick, StringVector* channels);
+
+    // a read only copy of the channel state for other threads, e.g. for statistics. Walking
+    // it takes no lock, neither the event delivery nor the connection waits for it, see
+    // ircStateSnapshot.h. It is as of the last input the connection processed, a copy is
+    // only made once something changed and only since the first call.
+    // Empty with state tracking turned off
+    IrcStateSnapshot getStateSnapshot();
+
+    // void IrCConnection :: setFloodControl(...)
+    //
+    // sets the budget of one outbound lane. Lines are queued per lane and target and released
+    // as fast as the budget allows, higher lanes first, see ircFloodControl.h. A lane's budget
+    // only limits it within the connection's budget, see setGlobalFloodControl(...). Chat may
+    // use all of it, control and bulk get less and keepalive is only bound by the global one.
+    // params:
+    // unsigned int lines       - lines per window, 0 lifts the limit
+    // unsigned int bytes       - bytes per window, 0 lifts the limit
+    // unsigned int window      - the window in ms
+    // IrcLane lane             - the lane to set the budget of
+    void setFloodControl(unsigned int lines, unsigned int bytes, unsigned int window, IrcLane lane = IRC_LANE_CHAT)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        Return_Void_Unless(lane < IRC_LANE_COUNT);
+        _lanes[lane].setBudget(lines, bytes, window);
+        _wakeupLoop();
+    };
+
+    // void IrCConnection :: setGlobalFloodControl(...)
+    //
+    // sets the budget all lanes draw from together, i.e. what the server gets to see.
+    // Defaults to IRC_FLOOD_DEFAULT_LINES lines and IRC_FLOOD_DEFAULT_BYTES bytes per
+    // IRC_FLOOD_DEFAULT_WINDOW ms
+    // params:
+    // unsigned int lines       - lines per window, 0 lifts the limit
+    // unsigned int bytes       - bytes per window, 0 lifts the limit
+    // unsigned int window      - the window in ms
+    void setGlobalFloodControl(unsigned int lines, unsigned int bytes, unsigned int window)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        _floodBudget.setBudget(lines, bytes, window);
+        _wakeupLoop();
+    };
+    IrcFloodMetrics getFloodMetrics(IrcLane lane = IRC_LANE_CHAT)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        Unless(lane < IRC_LANE_COUNT)
+            return IrcFloodMetrics();
+        return _lanes[lane].getMetrics();
+    };
+
+    // void IrCConnection :: setSendBufferWatermarks(...)
+    //
+    // nothing we queue is ever dropped, lines wait in the lanes for as long as it takes.
+    // Once more than high bytes wait on_send_buffer_high(...) is called, once that went
+    // down to low again on_send_buffer_drained(...), so producers know when to slow down.
+    // params:
+    // size_t high              - bytes waiting that count as too much, 0 turns it off
+    // size_t low               - bytes waiting that count as drained again
+    void setSendBufferWatermarks(size_t high, size_t low)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        _sendBufferHighMark = high;
+        _sendBufferLowMark = low < high ? low : high;
+        _wakeupLoop();
+    };
+    // bytes waiting in all lanes and the socket queue, what libirc already took isn't counted
+    size_t getSendBufferSize(){MutexHandle innerHandle(&_innerMutex); return _sendBufferSize(); };
+
+    // internal function only do not use directly!
+    // when the flood control releases its next line, 0 if none is waiting for the budget.
+    // Updated by addDescriptors(...), the reactor uses it as timeout.
+    millis_t getOutboundDeadline(){ MutexHandle innerHandle(&_innerMutex); return _outboundDeadline; };
+
+    // whether nick is ours, or whether two nicks are the same, as the server compares them
+    // (CASEMAPPING in RPL_ISUPPORT), e.g. "[Bot]" and "{bot}" are the same nick on most networks
+    bool isOwnNick(const String nick){MutexHandle innerHandle(&_innerMutex); return _isOwnNick(IrcStringView(nick.data(), nick.size())); };
+    bool nickEquals(const String nick, const String other)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        return _caps->getCaseMapping().equals(nick, IrcStringView(other.data(), other.size()));
+    };
+
+    // what the server told us about itself in RPL_ISUPPORT (005), the defaults until it did.
+    // Only takes the lock that guards the swap, the snapshot never changes, every 005 line
+    // publishes a new one. It stays valid as long as it is held, also after the connection
+    // is gone, so it can be kept and compared to a later one
+    IrcServerCapsHandle getServerCaps(){ MutexHandle snapshotHandle(&_snapshotMutex); return _capsHandle; };
+
+    // returns our "nick!user@host" as the server relays it to others, as learned from the
+    // welcome message or the echo of our first join. Empty until we know it.
+    String getOwnPrefix(){MutexHandle innerHandle(&_innerMutex); return _ownPrefix; };
+
+    // a handler for a single numeric reply, e.g. LIBIRC_RFC_RPL_NAMREPLY
+    typedef void (IrcConnection::*NumericHandler)(const IrcMessageView& message);
+
+    // void IrCConnection :: setNumericHandler(...)
+    //
+    // registers a method that is called for the given numeric instead of on_event(...).
+    // Lookup is a single array access, numerics without a handler are only delivered
+    // to on_event(...)/on_numeric_code(...) if IRC_EVENT_NUMERIC is in the event mask,
+    // otherwise they are dropped right away. Call it before start(), e.g. in the constructor:
+    //      setNumericHandler(LIBIRC_RFC_RPL_NAMREPLY, static_cast<NumericHandler>(&MyBot::on_names));
+    // params:
+    // unsigned int numeric     - the numeric, below IRC_NUMERIC_COUNT
+    // NumericHandler handler   - the method, NULL removes the handler
+    void setNumericHandler(unsigned int numeric, NumericHandler handler);
+
+    // whether dispatchMessage(...) would do anything with message, checked before the mutex is taken
+    bool wantsMessage(const IrcMessageView& message)
+    {
+        if(message.type != IRC_EVENT_NUMERIC)
+            return ((_sessionEventMask | _trackedMask) & IRC_EVENT_BIT(message.type)) != 0;
+        // the numerics _trackMessage(...) reads
+        if(message.numeric == 1 || message.numeric == 5 || (message.numeric == 353 && (_trackedMask & IRC_EVENT_MASK_STATE)))
+            return true;
+        return (_sessionEventMask & IRC_EVENT_BIT(IRC_EVENT_NUMERIC)) || _getNumericHandler(message);
+    };
+
+    // internal function only do not use directly!
+    // hands a received message to its numeric handler or on_event(...), expects getMutex() to be held
+    void dispatchMessage(const IrcMessageView& message)
+    {
+        if(IRC_EVENT_BIT(message.type) & _trackedMask)
+            _trackMessage(message);
+        NumericHandler handler = _getNumericHandler(message);
+        if(handler)
+            (this->*handler)(message);
+        else if(_sessionEventMask & IRC_EVENT_BIT(message.type))
+            _viewDispatcher(this, message);
+    };
+
     /********************************************************************/
     //                  Overwritable Methods                            //
     /********************************************************************/
@@ -102,6 +387,20 @@ public:
 
 
 
+    // void IrCConnection :: on_event(...)
+    //
+    // called upon every event except dcc requests, before any of the methods below.
+    // The default implementation converts the message into Strings and calls the
+    // matching on_*(...) method. Overwrite it to handle events without any copies or
+    // allocations, call Parent::on_event(...) for the events you still want delivered
+    // to the on_*(...) methods (at least for connect and unknown events, see above).
+    // params:
+    // IrcMessageView message   - the event, its views are only valid during this call
+    virtual void on_event(const IrcMessageView& message)
+    {
+        _dispatchLegacy(message);
+    };
+
     // void IrCConnection :: on_connect(...)
     //
     // called upon successful connection to the server
@@ -301,13 +600,16 @@ public:
         #ifdef IRC_CONNECTION_DEBUG
         if ( event > 400 )
         {
-            printf ("error %d: %s: %s %s %s %s\n", 
+            const char* name = irc_numeric_name(event);
+            size_t count = params.size();
+            printf ("error %d (%s): %s: %s %s %s %s\n", 
                 event,
+                name ? name : "unknown",
                 origin.size() ? origin.c_str() : "unknown",
-                params[0],
-                count > 1 ? params[1] : "",
-                count > 2 ? params[2] : "",
-                count > 3 ? params[3] : "");
+                count > 0 ? params[0].c_str() : "",
+                count > 1 ? params[1].c_str() : "",
+                count > 2 ? params[2].c_str() : "",
+                count > 3 ? params[3].c_str() : "");
         }
         #endif
     };
@@ -331,6 +633,20 @@ public:
     // irc_dcc_t dccid      - the dcc id
     virtual void on_dcc_send_req(const String nick, const String addr, const String filename, unsigned long size, irc_dcc_t dccid){};
 
+    // void IrCConnection :: on_send_buffer_high(...)
+    //
+    // called once more than the high watermark is waiting to be sent, see setSendBufferWatermarks(...)
+    // params:
+    // size_t pending       - the bytes waiting
+    virtual void on_send_buffer_high(size_t pending){};
+
+    // void IrCConnection :: on_send_buffer_drained(...)
+    //
+    // called once the send buffer went down to the low watermark after on_send_buffer_high(...)
+    // params:
+    // size_t pending       - the bytes waiting
+    virtual void on_send_buffer_drained(size_t pending){};
+
     //TODO: Figure out if necessary or should be cleaned up.
     /*int send_raw ( const char * format, ...)
     {
@@ -347,7 +663,7 @@ public:
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
         _tryingToConnect = false;
-        return irc_cmd_quit(_session, reason.c_str());
+        return _queueLine(IRC_LANE_KEEPALIVE, String(), String("QUIT :").append(reason));
     };
 
     // void IrCConnection :: quit(...)
@@ -361,6 +677,7 @@ public:
         Return_Void_Unless(_running);
         _tryingToConnect = false;
         irc_disconnect(_session);
+        _wakeupLoop();
     }
 
     // int IrCConnection :: join(...)
@@ -374,7 +691,16 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_join(_session, channel.c_str(), key.c_str());
+        // as many channels of that kind as CHANLIMIT allows already, the server would
+        // only answer ERR_TOOMANYCHANNELS
+        IrcStringView name(channel.data(), channel.size());
+        unsigned int limit = _caps->getChannelLimit(name);
+        if(limit != IRC_CAPS_UNLIMITED && !_state.isTracked(name) && _state.getChannelCount(name, *_caps) >= limit)
+            return -1;
+        String line = String("JOIN ").append(channel);
+        if(key.size())
+            line.append(" :").append(key);
+        return _queueLine(IRC_LANE_CONTROL, channel, line);
     };
 
     // int IrCConnection :: part(...)
@@ -387,7 +713,7 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_part(_session, channel.c_str());
+        return _queueLine(IRC_LANE_CONTROL, channel, String("PART ").append(channel));
     };
     
     // int IrCConnection :: invite(...)
@@ -401,31 +727,19 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_invite(_session, nick.c_str(), channel.c_str());
+        return _queueLine(IRC_LANE_CONTROL, channel, String("INVITE ").append(nick).append(" ").append(channel));
     };
     
     // int IrCConnection :: getNamesInChannel(...)
     //
-    // user method to obtain all usernames in a channel
+    // user method to obtain all usernames in a channel. For channels we are in they are
+    // taken from the channel state, for others NAMES is sent and they come in as numerics
     // params:
     // String channel       (in)   - the name of the channel
-    // String* channelNames (out)  - the string to contain the names in that channel
+    // String* channelNames (out)  - the names, space separated and prefixed like in RPL_NAMREPLY,
+    //                               or just the channel if NAMES had to be sent
     // return:          0 on success
-    int getNamesInChannel ( const String channel, String* channelNames)
-    {
-        MutexHandle innerHandle(&_innerMutex);
-        Return_MinusOne_Unless(_running);
-
-        char namebuf[2048];
-        strcpy(namebuf, channel.c_str());
-        
-        int retval = irc_cmd_names(_session, namebuf);
-
-        Return_MinusOne_Unless(retval == 0);
-
-        (*channelNames) = String(namebuf);
-        return retval;
-    };
+    int getNamesInChannel ( const String channel, String* channelNames);
 
     // int IrCConnection :: listChannels(...)
     //
@@ -438,11 +752,9 @@ public:
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
 
-        char namebuf[2048];
-        int retval = irc_cmd_list(_session, namebuf);
-
-        (*channelNames) = String(namebuf);
-        return retval;
+        // the channels come in as numerics
+        channelNames->clear();
+        return _queueLine(IRC_LANE_BULK, String(), String("LIST"));
     };
 
     // int IrCConnection :: setTopic(...)
@@ -456,7 +768,8 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_topic(_session, channel.c_str(), topic.c_str());
+        // an empty topic clears it
+        return _queueLine(IRC_LANE_CONTROL, channel, String("TOPIC ").append(channel).append(" :").append(topic));
     };
 
     // int IrCConnection :: channelMode(...)
@@ -470,9 +783,35 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_channel_mode(_session, channel.c_str(), mode.c_str());
+        String line = String("MODE ").append(channel);
+        if(mode.size())
+            line.append(" ").append(mode);
+        return _queueLine(IRC_LANE_CONTROL, channel, line);
     };
 
+    // int IrCConnection :: queueMode(...)
+    //
+    // user method to change a mode in a channel together with other changes, they go out
+    // combined as "MODE #chan +ooo a b c" as far as the server allows, see ircModeBatcher.h
+    // params:
+    // String channel       - the channel
+    // char sign            - '+' or '-'
+    // char mode            - the mode, e.g. 'o'
+    // String param         - its parameter, empty for modes without one
+    // return:          0 on success
+    int queueMode ( const String channel, char sign, char mode, const String param)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        Return_MinusOne_Unless(_running);
+        _modeBatcher.push(channel, sign, mode, param, getMilliseconds());
+        _wakeupLoop();
+        return 0;
+    };
+
+    // sets how long queueMode(...) waits for more changes to the same channel, defaults
+    // to IRC_MODE_BATCH_DELAY ms
+    void setModeBatchDelay(unsigned int delay){MutexHandle innerHandle(&_innerMutex); _modeBatcher.setDelay(delay); };
+
     // int IrCConnection :: userMode(...)
     //
     // user method to set our user mode
@@ -483,7 +822,10 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_user_mode(_session, mode.c_str());
+        String line = String("MODE ").append(_currentNick);
+        if(mode.size())
+            line.append(" ").append(mode);
+        return _queueLine(IRC_LANE_CONTROL, _currentNick, line);
     };
 
     // int IrCConnection :: setNick(...)
@@ -496,7 +838,10 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_nick(_session, newnick.c_str());
+        // longer than NICKLEN, the server would cut it or refuse it
+        if(newnick.size() > _caps->getNickLength())
+            return -1;
+        return _queueLine(IRC_LANE_CONTROL, _currentNick, String("NICK ").append(newnick));
     };
 
     // int IrCConnection :: whois(...)
@@ -510,29 +855,51 @@ public:
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
 
-        char whoisbuffer[2048];
-        strcpy(whoisbuffer, nick.c_str());
-        
-        int retval = irc_cmd_whois(_session, whoisbuffer);
-
-        Return_MinusOne_Unless(retval == 0);
-
-        (*information) = String(whoisbuffer);
-        return retval;
+        // the rest comes in as numerics, what we can hand back is "nick!user@host" if we
+        // share a channel with nick, otherwise just the nick
+        Unless(_state.getUserPrefix(IrcStringView(nick.data(), nick.size()), information))
+            (*information) = nick;
+        return _queueLine(IRC_LANE_BULK, nick, String("WHOIS ").append(nick).append(" ").append(nick));
     };
 
     // int IrCConnection :: sendMessage(...)
     //
-    // user method to send a message to a certain channel
+    // user method to send a message to a certain channel. Text that would not fit into
+    // the 512 bytes the server relays is split at word (or at least utf-8 character)
+    // boundaries and line breaks and sent as several messages, the same goes for
+    // sendActionMessage(...), notice(...) and the broadcasts.
     // params:
     // String channel       - the channel
     // String text          - the text to send
     // return:          0 on success
-    int sendMessage  ( const String channel, const String text)
+    int sendMessage  ( const String channel, const String text){ return sendMessage(channel, IrcPayload(text)); };
+    // same, with text that is shared with other connections or targets, see ircPayload.h
+    int sendMessage  ( const String channel, const IrcPayload& text)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        Return_MinusOne_Unless(_running);
+        return _queueText(IRC_LANE_CHAT, "PRIVMSG", channel, text);
+    };
+
+    // int IrCConnection :: broadcastMessage(...)
+    //
+    // user method to send the same message to many channels or users at once. The targets
+    // are merged into as few lines as the server allows, see TARGMAX in RPL_ISUPPORT
+    // (PRIVMSG #a,#b,#c :text), without that it is a line per target like sendMessage(...).
+    // A merged line is queued under its whole target list, not under each target, so it is
+    // not ordered against sendMessage(...) to the same targets. Either may go out first,
+    // use sendMessage(...) per target where the order matters
+    // params:
+    // StringVector targets - the channels or nicks
+    // String text          - the text to send
+    // return:          0 on success
+    int broadcastMessage ( const StringVector& targets, const String text){ return broadcastMessage(targets, IrcPayload(text)); };
+    // same, relaying one payload to many targets on many connections only copies it once
+    int broadcastMessage ( const StringVector& targets, const IrcPayload& text)
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_msg(_session, channel.c_str(), text.c_str());
+        return _queueBroadcast("PRIVMSG", IRC_COMMAND_PRIVMSG, targets, text);
     };
 
     // int IrCConnection :: sendActionMessage(...)
@@ -546,7 +913,7 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_me(_session, channel.c_str(), text.c_str());
+        return _queueText(IRC_LANE_CHAT, "PRIVMSG", channel, IrcPayload(text), "ACTION");
     };
 
     // int IrCConnection :: notice(...)
@@ -556,11 +923,28 @@ public:
     // String chanOrNick    - the channel or users nick
     // String text          - the text to send
     // return:          0 on success
-    int notice ( const String chanOrNick, const String text)
+    int notice ( const String chanOrNick, const String text){ return notice(chanOrNick, IrcPayload(text)); };
+    int notice ( const String chanOrNick, const IrcPayload& text)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        Return_MinusOne_Unless(_running);
+        return _queueText(IRC_LANE_CHAT, "NOTICE", chanOrNick, text);
+    };
+
+    // int IrCConnection :: broadcastNotice(...)
+    //
+    // user method to send the same notice to many channels or users, see broadcastMessage(...)
+    // for how it is ordered against other notices
+    // params:
+    // StringVector targets - the channels or nicks
+    // String text          - the text to send
+    // return:          0 on success
+    int broadcastNotice ( const StringVector& targets, const String text){ return broadcastNotice(targets, IrcPayload(text)); };
+    int broadcastNotice ( const StringVector& targets, const IrcPayload& text)
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_notice(_session, chanOrNick.c_str(), text.c_str());
+        return _queueBroadcast("NOTICE", IRC_COMMAND_NOTICE, targets, text);
     };
 
     // int IrCConnection :: kick(...)
@@ -575,7 +959,10 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_kick(_session, nick.c_str(), channel.c_str(), reason.c_str());
+        String line = String("KICK ").append(channel).append(" ").append(nick);
+        if(reason.size())
+            line.append(" :").append(reason);
+        return _queueLine(IRC_LANE_CONTROL, channel, line);
     };
 
     // int IrCConnection :: ctcpRequest(...)
@@ -588,7 +975,7 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_ctcp_request(_session, nick.c_str(), request.c_str());
+        return _queueLine(IRC_LANE_CHAT, nick, String("PRIVMSG ").append(nick).append(" :\x01").append(request).append("\x01"));
     };
 
     // int IrCConnection :: ctcpReply(...)
@@ -602,12 +989,40 @@ public:
     {
         MutexHandle innerHandle(&_innerMutex);
         Return_MinusOne_Unless(_running);
-        return irc_cmd_ctcp_reply(_session, nick.c_str(), reply.c_str());
+        return _queueLine(IRC_LANE_CHAT, nick, String("NOTICE ").append(nick).append(" :\x01").append(reply).append("\x01"));
+    };
+
+    // int IrCConnection :: queueLine(...)
+    //
+    // queues a finished protocol line, e.g. one built by IrcLineBuilder
+    // params:
+    // IrcLane lane         - the lane it goes out on
+    // String target        - the flood control queue it goes to, lines of one target stay in order
+    // String line          - the line without its line end
+    // return:          0 on success, -1 if not running or the line could never be sent
+    int queueLine ( IrcLane lane, const String& target, const String& line)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        Return_MinusOne_Unless(_running && lane < IRC_LANE_COUNT);
+        return _queueLine(lane, target, line);
+    };
+
+    // size_t IrCConnection :: getTextLimit(...)
+    //
+    // how much text fits behind a header like "PRIVMSG target :" once the server put our
+    // prefix in front
+    // params:
+    // size_t headerLength  - the length of the header
+    // return:          the bytes left for text
+    size_t getTextLimit ( size_t headerLength)
+    {
+        MutexHandle innerHandle(&_innerMutex);
+        return _textLimit(headerLength);
     };
 
     // bool IrCConnection :: getNick(...)
     //
-    // user method to retrieve nick from string
+    // user method to retrieve nick from string, does not lock
     // params:
     // String target (in)       - the string the users nick should be extracted from 
     // String* nick  (out)      - pointer to the string containing the extracted users nick (may be empty) 
@@ -615,29 +1030,27 @@ public:
     //              false otherwise
     bool getNick (const String target, String* nick) 
     {
-        MutexHandle innerHandle(&_innerMutex);
-        Return_False_Unless(_running);
-        char nickbuf[128];
-        irc_target_get_nick(target.c_str(), nickbuf, sizeof(nickbuf));
-        (*nick) = String(nickbuf);
+        IrcPrefix prefix(IrcStringView(target.data(), target.size()));
+        nick->assign(prefix.nick.data, prefix.nick.size);
         return nick->size() > 0;
     };
 
     // bool IrCConnection :: getHost(...)
     //
-    // user method to retrieve hostname from string
+    // user method to retrieve hostname from string, does not lock
     // params:
-    // String target (in)       - the string the hostname/IP should be extracted from 
+    // String target (in)       - the string the hostname/IP should be extracted from, "nick!user@host"
+    //                            or just a host/server name
     // String* host  (out)      - pointer to the string containing the extracted host name/IP (may be empty) 
-    // return:      true if a nick of length > 0 is returned,
+    // return:      true if a host of length > 0 is returned,
     //              false otherwise
     bool getHost (const String target, String* host)
     {
-        MutexHandle innerHandle(&_innerMutex);
-        Return_False_Unless(_running);
-        char hostbuf[128];
-        irc_target_get_host(target.c_str(), hostbuf, sizeof(hostbuf));
-        (*host) = String(hostbuf);
+        IrcPrefix prefix(IrcStringView(target.data(), target.size()));
+        if(prefix.host.empty() && prefix.user.empty())
+            *host = target;
+        else
+            host->assign(prefix.host.data, prefix.host.size);
         return host->size() > 0;
     };
 
@@ -655,8 +1068,89 @@ public:
 
 
 protected:
+    friend class IrcReactorLoop;
+
+    // fills _callbacks, _viewDispatcher and the masks of the session according to _eventMask,
+    // expects _innerMutex to be held.
+    // BasicIrcConnection<...> overwrites it to install its own callbacks.
+    virtual void _setCallbacks();
+
+    // hands a view to on_event(...), the native input path uses it instead of _callbacks
+    typedef void (*ViewDispatcher)(IrcConnection* connection, const IrcMessageView& message);
+
+    NumericHandler _getNumericHandler(const IrcMessageView& message)
+    {
+        if(message.type != IRC_EVENT_NUMERIC || !_numericHandlers || message.numeric >= IRC_NUMERIC_COUNT)
+            return NULL;
+        return _numericHandlers[message.numeric];
+    };
 
-    void _setCallbacks();
+    // irc_process_select_descriptors, but input of native sessions is read by us
+    int _processSession(fd_set* in_set, fd_set* out_set);
+    // reads and dispatches what arrived on _socket, returns -1 if the connection is gone
+    int _readNativeInput();
+    // does what libirc does for a received line: answers pings, keeps track of our nick and
+    // turns it into the same events libirc would, then dispatches them
+    void _onNativeLine(const IrcParsedLine& line);
+    void _dispatchNative(const IrcMessageView& message);
+    void _replyCtcp(const IrcStringView& nick, const IrcStringView& request);
+
+    // the default of on_event(...), calls the String based on_*(...) methods
+    void _dispatchLegacy(const IrcMessageView& message);
+
+    // shared by run() and tick(), expect _innerMutex to be held
+    int _openSession();
+    int _connectSession(unsigned int attempt);
+    // the select loop of run(), like irc_run but it also wakes up for _wakeup
+    int _runSession();
+
+    // wake whatever loop drives us, so queued output is written right away instead of after
+    // the select timeout. Expect _innerMutex to be held.
+    void _wakeupLoop();
+    int _signalOutbound(int retval){ if(retval == 0) _wakeupLoop(); return retval; };
+
+    // hands a line to the flood control of a lane, expects _innerMutex to be held.
+    // Returns -1 for lines that could never be sent, see _fitsLine(...)
+    int _queueLine(IrcLane lane, const String& target, const String& line);
+    // whether a line of length bytes, without its line end, gets to the server whole
+    bool _fitsLine(size_t length);
+    // queues text for all targets with as many targets per line as _caps allows, returns -1
+    // if the lines for some of them could not be queued. Expects _innerMutex to be held
+    int _queueBroadcast(const char* command, IrcCommand commandId, const StringVector& targets, const IrcPayload& text);
+    // picks up what the connection itself needs to know, see IRC_EVENT_MASK_TRACKED and
+    // IRC_EVENT_MASK_STATE
+    void _trackMessage(const IrcMessageView& message);
+    // updates _state, expects _innerMutex to be held
+    void _trackState(const IrcMessageView& message);
+    // makes caps the snapshot getServerCaps() returns. Takes ownership, if it equals the
+    // current one that one stays. Expects _innerMutex to be held
+    void _publishCaps(IrcServerCaps* caps);
+    // publishes a new _stateSnapshot if the state changed since the last one and anyone
+    // asked for one, expects neither mutex to be held
+    void _publishState();
+    // hands the CASEMAPPING of _caps to everything that keys by nick or channel,
+    // expects _innerMutex to be held
+    void _applyCaseMapping();
+    bool _isOwnNick(const IrcStringView& nick) const { return _caps->getCaseMapping().equals(_currentNick, nick); };
+    // queues "COMMAND target :text", split into as many lines as it takes to get the whole text
+    // relayed, with ctcp each piece is wrapped in "\x01ctcp ...\x01". The lines refer to text
+    // instead of copying it. Returns -1 if target leaves no room for text. Expects _innerMutex
+    // to be held
+    int _queueText(IrcLane lane, const char* command, const String& target, const IrcPayload& text, const char* ctcp = NULL);
+    // how much text fits into "COMMAND target :" once the server put our prefix in front
+    size_t _textLimit(size_t headerLength);
+    // passes what the lanes release on to the socket queue of native sessions or to libirc,
+    // highest lane first, expects _innerMutex to be held. Returns when the next line is due,
+    // 0 if nothing waits or what was handed on has to be written first
+    millis_t _flushOutbound(millis_t now);
+    // irc_add_select_descriptors(...) plus the socket of a native session if _sendQueue
+    // has something to write, expects _innerMutex to be held
+    int _addSessionDescriptors(fd_set* in_set, fd_set* out_set, int* maxfd);
+    // what the lanes and the socket queue hold, expects _innerMutex to be held
+    size_t _sendBufferSize();
+    // calls on_send_buffer_high(...) or on_send_buffer_drained(...) if the send buffer crossed
+    // a watermark, expects neither mutex to be held
+    void _notifySendBuffer();
 
     irc_callbacks_t         _callbacks;
     IRCServerInfo           _serverInfo;
@@ -665,8 +1159,61 @@ protected:
     bool                    _running;
     bool                    _tryingToConnect;
     unsigned int            _reconectDelay;
+    unsigned int            _eventMask;
+    // _eventMask as of the session and the events _trackMessage(...) wants, both set by
+    // _setCallbacks(), the input of a session only reads these
+    unsigned int            _sessionEventMask;
+    unsigned int            _trackedMask;
+    ViewDispatcher          _viewDispatcher;
+    // IRC_NUMERIC_COUNT entries, only allocated once a handler is set
+    NumericHandler*         _numericHandlers;
+    IrcFloodControl         _lanes[IRC_LANE_COUNT];
+    // shared by all lanes
+    IrcFloodBudget          _floodBudget;
+    millis_t                _outboundDeadline;
+    IrcModeBatcher          _modeBatcher;
+    size_t                  _sendBufferHighMark;
+    size_t                  _sendBufferLowMark;
+    bool                    _sendBufferHigh;
+    // native sessions write the lines themselves, libirc only what it queues on its own
+    IrcSendQueue            _sendQueue;
+    bool                    _sendWriting;
+    // the current RPL_ISUPPORT snapshot, only swapped with _innerMutex and _snapshotMutex
+    // held. _caps is what _capsHandle refers to, for use under _innerMutex
+    IrcServerCapsHandle     _capsHandle;
+    const IrcServerCaps*    _caps;
+
+    // native input, see setNativeInput(...)
+    bool                    _nativeInput;
+    bool                    _nativeSession;
+    int                     _socket;
+    char*                   _inBuffer;
+    size_t                  _inLength;
+    bool                    _inSkipLine;
+    bool                    _motdReceived;
+
+    // what we know about ourselves, see _trackMessage(...)
+    String                  _currentNick;
+    String                  _ownPrefix;
+    // who is in our channels, only kept if _trackedMask has IRC_EVENT_MASK_STATE
+    bool                    _stateTracking;
+    IrcStateTracker         _state;
+    // what getStateSnapshot() hands out, _snapshotMutex is held only to copy or replace it.
+    // Nothing is copied before the first call sets _stateSnapshots
+    IrcStateSnapshot        _stateSnapshot;
+    bool                    _stateSnapshots;
+    IRC_MUTEX_HANDLE        _snapshotMutex;
     IRC_MUTEX_HANDLE        _mutex;
     IRC_MUTEX_HANDLE        _innerMutex;
+
+    // reactor mode only
+    IrcReactorLoop*         _reactorLoop;
+    millis_t                _nextConnectAttempt;
+    unsigned int            _connectRetries;
+    unsigned int            _sessionGeneration;
+
+    // thread mode only
+    WakeupChannel*          _wakeup;
 };
 
 
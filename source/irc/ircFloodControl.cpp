@@ -0,0 +1,280 @@
+#include "ircFloodControl.h"
+
+//ircFloodControl.cpp
+//Author: Simon Wittenberg
+
+
+IrcFloodBudget::IrcFloodBudget()
+{
+    _lastRefill = 0;
+    setBudget(IRC_FLOOD_DEFAULT_LINES, IRC_FLOOD_DEFAULT_BYTES, IRC_FLOOD_DEFAULT_WINDOW);
+}
+
+void IrcFloodBudget::setBudget(unsigned int lines, unsigned int bytes, millis_t window)
+{
+    _lines = lines;
+    _bytes = bytes;
+    _window = window ? window : 1;
+    _lineCredit = (unsigned long long)_lines * _window;
+    _byteCredit = (unsigned long long)_bytes * _window;
+}
+
+void IrcFloodBudget::_refill(millis_t now)
+{
+    if(now <= _lastRefill)
+        return;
+    millis_t elapsed = now - _lastRefill;
+    _lastRefill = now;
+
+    unsigned long long lineMax = (unsigned long long)_lines * _window;
+    unsigned long long byteMax = (unsigned long long)_bytes * _window;
+    // past a whole window the bucket is full anyway, this also keeps the products small
+    if(elapsed >= _window)
+    {
+        _lineCredit = lineMax;
+        _byteCredit = byteMax;
+        return;
+    }
+    _lineCredit += elapsed * _lines;
+    _byteCredit += elapsed * _bytes;
+    if(_lineCredit > lineMax)
+        _lineCredit = lineMax;
+    if(_byteCredit > byteMax)
+        _byteCredit = byteMax;
+}
+
+unsigned long long IrcFloodBudget::_byteCost(size_t bytes) const
+{
+    unsigned long long cost = bytes;
+    if(cost > _bytes)
+        cost = _bytes;
+    return cost * _window;
+}
+
+bool IrcFloodBudget::fits(size_t bytes, millis_t now)
+{
+    _refill(now);
+    if(_lines && _lineCredit < _window)
+        return false;
+    if(_bytes && _byteCredit < _byteCost(bytes))
+        return false;
+    return true;
+}
+
+void IrcFloodBudget::charge(size_t bytes)
+{
+    if(_lines)
+        _lineCredit = _lineCredit > _window ? _lineCredit - _window : 0;
+    if(_bytes)
+    {
+        unsigned long long cost = _byteCost(bytes);
+        _byteCredit = _byteCredit > cost ? _byteCredit - cost : 0;
+    }
+}
+
+millis_t IrcFloodBudget::wait(size_t bytes, millis_t now)
+{
+    _refill(now);
+    millis_t wait = 0;
+    if(_lines && _lineCredit < _window)
+        wait = (millis_t)((_window - _lineCredit + _lines - 1) / _lines);
+    unsigned long long cost = _byteCost(bytes);
+    if(_bytes && _byteCredit < cost)
+    {
+        millis_t byteWait = (millis_t)((cost - _byteCredit + _bytes - 1) / _bytes);
+        if(byteWait > wait)
+            wait = byteWait;
+    }
+    return wait;
+}
+
+
+IrcFloodControl::IrcFloodControl()
+{
+    _shared = NULL;
+    _pendingLines = 0;
+    _pendingBytes = 0;
+}
+
+IrcFloodControl::~IrcFloodControl()
+{
+    clear();
+}
+
+void IrcFloodControl::push(const std::string& target, const std::string& line, millis_t now)
+{
+    IrcOutboundLine text;
+    text.head = line;
+    push(target, text, now);
+}
+
+void IrcFloodControl::setCaseMapping(const IrcCaseMapping& mapping)
+{
+    Return_Void_Unless(mapping != _mapping);
+    _mapping = mapping;
+    // targets that are the same now keep their own queues until they run empty, so none
+    // of their lines overtake each other
+    _targets.clear();
+    for(std::deque<Target*>::iterator i = _ready.begin(); i != _ready.end(); ++i)
+    {
+        Target* target = *i;
+        target->hash = _mapping.hash(IrcStringView(target->name.data(), target->name.size()));
+        Target** first = _targets.find(target->hash);
+        target->next = first ? *first : NULL;
+        _targets.set(target->hash, target);
+    }
+}
+
+void IrcFloodControl::push(const std::string& target, IrcOutboundLine& line, millis_t now)
+{
+    // "#Chan" and "#chan" are the same queue, so their lines stay in order
+    IrcStringView name(target.data(), target.size());
+    unsigned int hash = _mapping.hash(name);
+    Target** first = _targets.find(hash);
+    Target* entry = first ? *first : NULL;
+    while(entry && !_mapping.equals(entry->name, name))
+        entry = entry->next;
+    if(!entry)
+    {
+        entry = new Target();
+        entry->name = target;
+        entry->hash = hash;
+        entry->next = first ? *first : NULL;
+        _targets.set(hash, entry);
+    }
+    if(entry->lines.empty())
+        _ready.push_back(entry);
+
+    entry->lines.push_back(Line());
+    Line& queued = entry->lines.back();
+    queued.queued = now;
+    queued.text.swap(line);
+    size_t size = queued.text.length();
+
+    _pendingLines++;
+    _pendingBytes += size + 2;
+    _metrics.queuedLines++;
+}
+
+const IrcOutboundLine* IrcFloodControl::front(millis_t now)
+{
+    Return_NULL_Unless(_pendingLines);
+    const Line& line = _ready.front()->lines.front();
+    size_t bytes = line.text.length() + 2;
+    Return_NULL_Unless(_budget.fits(bytes, now));
+    Return_NULL_Unless(!_shared || _shared->fits(bytes, now));
+    return &line.text;
+}
+
+void IrcFloodControl::pop(millis_t now)
+{
+    pop(now, NULL);
+}
+
+void IrcFloodControl::pop(millis_t now, IrcOutboundLine* text)
+{
+    Return_Void_Unless(_pendingLines);
+    const Line& line = _ready.front()->lines.front();
+    size_t bytes = line.text.length() + 2;
+
+    _budget.charge(bytes);
+    if(_shared)
+        _shared->charge(bytes);
+
+    if(now > line.queued)
+    {
+        _metrics.delayedLines++;
+        if(now - line.queued > _metrics.maxDelay)
+            _metrics.maxDelay = now - line.queued;
+    }
+    _metrics.sentLines++;
+    _metrics.sentBytes += bytes;
+    _remove(text);
+}
+
+void IrcFloodControl::drop()
+{
+    Return_Void_Unless(_pendingLines);
+    _metrics.droppedLines++;
+    _remove(NULL);
+}
+
+void IrcFloodControl::_remove(IrcOutboundLine* text)
+{
+    Target* target = _ready.front();
+    _ready.pop_front();
+    Line& line = target->lines.front();
+    _pendingLines--;
+    _pendingBytes -= line.text.length() + 2;
+
+    if(text)
+        text->swap(line.text);
+    target->lines.pop_front();
+    // the target gets its next turn after all others that are waiting
+    if(target->lines.size())
+        _ready.push_back(target);
+    else
+    {
+        _unlink(target);
+        delete target;
+    }
+}
+
+void IrcFloodControl::_unlink(Target* target)
+{
+    Target** link = _targets.find(target->hash);
+    Return_Void_Unless(link);
+    if(*link == target)
+    {
+        if(target->next)
+            *link = target->next;
+        else
+            _targets.erase(target->hash);
+        return;
+    }
+    for(Target* other = *link; other; other = other->next)
+    {
+        if(other->next == target)
+        {
+            other->next = target->next;
+            return;
+        }
+    }
+}
+
+millis_t IrcFloodControl::nextRelease(millis_t now)
+{
+    Return_Zero_Unless(_pendingLines);
+    const Line& line = _ready.front()->lines.front();
+    size_t bytes = line.text.length() + 2;
+
+    millis_t wait = _budget.wait(bytes, now);
+    if(_shared)
+    {
+        millis_t sharedWait = _shared->wait(bytes, now);
+        if(sharedWait > wait)
+            wait = sharedWait;
+    }
+    return now + wait;
+}
+
+void IrcFloodControl::clear()
+{
+    // every target with lines is in _ready and only those are kept
+    for(std::deque<Target*>::iterator i = _ready.begin(); i != _ready.end(); ++i)
+        delete *i;
+    _targets.clear();
+    _ready.clear();
+    _metrics.droppedLines += _pendingLines;
+    _pendingLines = 0;
+    _pendingBytes = 0;
+}
+
+IrcFloodMetrics IrcFloodControl::getMetrics() const
+{
+    IrcFloodMetrics metrics(_metrics);
+    metrics.pendingLines = _pendingLines;
+    metrics.pendingBytes = _pendingBytes;
+    metrics.pendingTargets = (unsigned int)_ready.size();
+    return metrics;
+}
@@ -0,0 +1,191 @@
+#ifndef _IRC_FLOOD_CONTROL_H_
+#define _IRC_FLOOD_CONTROL_H_
+#include <string>
+#include <deque>
+#include <util/threadHelper.h>
+#include <util/util.h>
+#include <util/openHashMap.h>
+#include <irc/ircMessage.h>
+#include <irc/ircPayload.h>
+#include <irc/ircCaseMapping.h>
+
+//ircFloodControl.h
+//Author: Simon Wittenberg
+
+// Outbound scheduler that keeps us below the flood limits of the server, instead of
+// finding out about them by being throttled.
+// Lines are queued per target (channel or nick) and released round robin, one line per
+// target at a time, so a bot flooding one channel does not hold up its replies in others.
+// Releasing is bound by a token bucket with two budgets, lines and bytes per window.
+// Both refill continuously, with the defaults a burst of 5 lines goes out right away and
+// after that a line every 2 seconds, which is about what ircu, hybrid and ratbox tolerate.
+// A queue may draw from a shared bucket on top of its own, see setSharedBudget(...).
+// Not thread safe, IrcConnection guards it with its inner mutex.
+
+#define IRC_FLOOD_DEFAULT_LINES     5
+#define IRC_FLOOD_DEFAULT_BYTES     2560
+#define IRC_FLOOD_DEFAULT_WINDOW    10000
+
+// IrcConnection keeps one IrcFloodControl per lane and always empties the higher lanes
+// first, so a PONG or a KICK never waits behind a burst of chat. All lanes draw from one
+// shared budget with the defaults above, which is what the server gets to see. The
+// budgets of the lanes are limits within it, so e.g. bulk can't take all of it.
+enum IrcLane
+{
+    IRC_LANE_KEEPALIVE = 0, // PONG, never limited
+    IRC_LANE_CONTROL,       // JOIN, PART, MODE, KICK, TOPIC, INVITE, NICK
+    IRC_LANE_CHAT,          // messages, notices and ctcps
+    IRC_LANE_BULK,          // NAMES, LIST, WHOIS and the automatic ctcp replies
+    IRC_LANE_COUNT
+};
+
+#define IRC_FLOOD_CONTROL_LINES     5
+#define IRC_FLOOD_CONTROL_BYTES     2048
+#define IRC_FLOOD_BULK_LINES        2
+#define IRC_FLOOD_BULK_BYTES        1024
+
+struct IrcFloodMetrics
+{
+    IrcFloodMetrics()
+    :   queuedLines(0),
+        sentLines(0),
+        sentBytes(0),
+        delayedLines(0),
+        droppedLines(0),
+        maxDelay(0),
+        pendingLines(0),
+        pendingBytes(0),
+        pendingTargets(0)
+    {}
+    unsigned long long  queuedLines;    // lines handed to us
+    unsigned long long  sentLines;      // lines released to the server
+    unsigned long long  sentBytes;      // including the line ends
+    unsigned long long  delayedLines;   // lines that had to wait for the budget
+    unsigned long long  droppedLines;   // lines thrown away by clear(), e.g. on reconnect, or drop()
+    millis_t            maxDelay;       // the longest a line waited, in ms
+    unsigned int        pendingLines;   // waiting right now
+    size_t              pendingBytes;
+    unsigned int        pendingTargets;
+};
+
+// the token bucket itself, lines and bytes per window
+class IrcFloodBudget
+{
+public:
+    IrcFloodBudget();
+
+    // void IrcFloodBudget :: setBudget(...)
+    //
+    // sets the budget and fills the bucket
+    // params:
+    // unsigned int lines   - lines per window, 0 lifts the limit
+    // unsigned int bytes   - bytes per window including the line ends, 0 lifts the limit
+    // millis_t window      - the window in ms
+    void setBudget(unsigned int lines, unsigned int bytes, millis_t window);
+
+    // whether a line of bytes, including its line end, may go out now
+    bool fits(size_t bytes, millis_t now);
+    // takes a line of bytes out of the bucket
+    void charge(size_t bytes);
+    // how many ms until a line of bytes fits
+    millis_t wait(size_t bytes, millis_t now);
+
+private:
+    void _refill(millis_t now);
+    // what a line costs of the byte budget, never more than the whole bucket
+    unsigned long long _byteCost(size_t bytes) const;
+
+    // credits are scaled by the window, a line costs _window line credits and
+    // a byte _window byte credits, refilling adds _lines and _bytes per ms
+    unsigned int                    _lines;
+    unsigned int                    _bytes;
+    millis_t                        _window;
+    unsigned long long              _lineCredit;
+    unsigned long long              _byteCredit;
+    millis_t                        _lastRefill;
+};
+
+class IrcFloodControl
+{
+public:
+    IrcFloodControl();
+    ~IrcFloodControl();
+
+    // void IrcFloodControl :: setBudget(...)
+    //
+    // sets the budget and fills the bucket
+    // params:
+    // unsigned int lines   - lines per window, 0 lifts the limit
+    // unsigned int bytes   - bytes per window including the line ends, 0 lifts the limit
+    // millis_t window      - the window in ms
+    void setBudget(unsigned int lines, unsigned int bytes, millis_t window){ _budget.setBudget(lines, bytes, window); };
+    // lines are only released if shared has room for them as well and are charged to both,
+    // NULL for none. shared has to outlive us
+    void setSharedBudget(IrcFloodBudget* shared){ _shared = shared; };
+
+    // which targets are the same queue, "#Chan" and "#chan" are unless set otherwise
+    void setCaseMapping(const IrcCaseMapping& mapping);
+
+    // queues a line, without its line end, for target
+    void push(const std::string& target, const std::string& line, millis_t now);
+    // same, takes over line and leaves it empty
+    void push(const std::string& target, IrcOutboundLine& line, millis_t now);
+
+    // returns the line that may be sent now or NULL if nothing is queued or the budget is
+    // used up. It stays queued until pop(...), so a line the session can't take isn't lost
+    const IrcOutboundLine* front(millis_t now);
+    // charges the budget for the line front(...) returned and drops it from the queue
+    void pop(millis_t now);
+    // same, the line is moved to line instead of freed
+    void pop(millis_t now, IrcOutboundLine* line);
+    // drops the line front(...) returned without charging the budget, for lines the
+    // session can never take
+    void drop();
+
+    // when front(...) is going to return a line, 0 if nothing is queued
+    millis_t nextRelease(millis_t now);
+
+    // drops everything that is queued
+    void clear();
+
+    bool empty() const { return _pendingLines == 0; };
+    // bytes waiting right now, including the line ends
+    size_t pendingBytes() const { return _pendingBytes; };
+    IrcFloodMetrics getMetrics() const;
+
+private:
+    struct Line
+    {
+        IrcOutboundLine text;
+        millis_t        queued;
+    };
+
+    struct Target
+    {
+        std::string         name;
+        unsigned int        hash;
+        // the next target with the same hash, see _targets
+        Target*             next;
+        std::deque<Line>    lines;
+    };
+
+    // takes the first line of the first ready target off the queue
+    void _remove(IrcOutboundLine* text);
+    void _unlink(Target* target);
+
+    // the hash of a target's name to the first target with it, the others are chained
+    // through their next
+    OpenHashMap<Target*>            _targets;
+    IrcCaseMapping                  _mapping;
+    // the targets with queued lines, in the order they get their turn
+    std::deque<Target*>             _ready;
+
+    IrcFloodBudget                  _budget;
+    IrcFloodBudget*                 _shared;
+
+    unsigned int                    _pendingLines;
+    size_t                          _pendingBytes;
+    IrcFloodMetrics                 _metrics;
+};
+
+#endif //_IRC_FLOOD_CONTROL_H_
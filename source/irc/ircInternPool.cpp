@@ -0,0 +1,282 @@
+#include "ircInternPool.h"
+#include <stdlib.h>
+#include <string.h>
+
+//ircInternPool.cpp
+//Author: Simon Wittenberg
+
+// names longer than this are folded into a std::string, shorter ones on the stack
+#define IRC_INTERN_FOLD_BUFFER 128
+
+
+static IrcInternPool irc_intern_global;
+// the text of the empty name, it needs no slot
+static char irc_intern_empty[1] = { 0 };
+
+IrcInternPool& IrcInternPool::global()
+{
+    return irc_intern_global;
+}
+
+
+IrcInternPool::IrcInternPool()
+{
+    for(unsigned int i = 0; i < IRC_INTERN_SHARDS; i++)
+    {
+        Shard& shard = _shards[i];
+        INIT_MUTEX(shard.mutex);
+        memset((void*)shard.pages, 0, sizeof(shard.pages));
+        shard.count = 0;
+        shard.used = 0;
+        shard.chunk = NULL;
+        shard.chunkLeft = 0;
+        shard.bytes = 0;
+    }
+}
+
+IrcInternPool::~IrcInternPool()
+{
+    for(unsigned int i = 0; i < IRC_INTERN_SHARDS; i++)
+    {
+        Shard& shard = _shards[i];
+        // names of their own that are still in use
+        for(unsigned int index = 0; index < shard.count; index++)
+        {
+            Entry& entry = shard.pages[index / IRC_INTERN_PAGE_SIZE][index % IRC_INTERN_PAGE_SIZE];
+            if(_slotClass(entry.length) > IRC_INTERN_SLOT_CLASSES)
+                free(entry.text);
+        }
+        for(unsigned int page = 0; page < IRC_INTERN_MAX_PAGES && shard.pages[page]; page++)
+            free(shard.pages[page]);
+        for(size_t block = 0; block < shard.blocks.size(); block++)
+            free(shard.blocks[block]);
+        DESTROY_MUTEX(shard.mutex);
+    }
+}
+
+unsigned int IrcInternPool::_hash(const IrcStringView& text)
+{
+    // FNV-1a, the names are short
+    unsigned int hash = 2166136261u;
+    for(size_t i = 0; i < text.size; i++)
+    {
+        hash ^= (unsigned char)text.data[i];
+        hash *= 16777619u;
+    }
+    return hash == OPEN_HASH_MAP_EMPTY ? hash - 1 : hash;
+}
+
+unsigned int IrcInternPool::_slotClass(size_t length)
+{
+    size_t slotClass = (length + IRC_INTERN_SLOT_SIZE - 1) / IRC_INTERN_SLOT_SIZE;
+    return slotClass <= IRC_INTERN_SLOT_CLASSES ? (unsigned int)slotClass : IRC_INTERN_SLOT_CLASSES + 1;
+}
+
+unsigned int IrcInternPool::_find(const Shard& shard, const IrcStringView& text, unsigned int hash) const
+{
+    const unsigned int* first = shard.index.find(hash);
+    for(unsigned int index = first ? *first : IRC_SYMBOL_NONE; index != IRC_SYMBOL_NONE; )
+    {
+        const Entry& entry = shard.pages[index / IRC_INTERN_PAGE_SIZE][index % IRC_INTERN_PAGE_SIZE];
+        if(entry.length == text.size && memcmp(entry.text, text.data, text.size) == 0)
+            return index;
+        index = entry.next;
+    }
+    return IRC_SYMBOL_NONE;
+}
+
+unsigned int IrcInternPool::_allocate(Shard& shard, size_t length)
+{
+    unsigned int slotClass = _slotClass(length);
+    std::vector<unsigned int>& freeEntries = shard.freeEntries[slotClass];
+    unsigned int index;
+    bool reused = freeEntries.size() > 0;
+    if(reused)
+        index = freeEntries.back();
+    else
+    {
+        index = shard.count;
+        unsigned int page = index / IRC_INTERN_PAGE_SIZE;
+        Unless(page < IRC_INTERN_MAX_PAGES)
+            return IRC_SYMBOL_NONE;
+        if(!shard.pages[page])
+        {
+            Entry* entries = (Entry*)malloc(IRC_INTERN_PAGE_SIZE * sizeof(Entry));
+            Unless(entries)
+                return IRC_SYMBOL_NONE;
+            shard.bytes += IRC_INTERN_PAGE_SIZE * sizeof(Entry);
+            // no symbol of the page is handed out before its entry is complete, readers
+            // in other threads only get one through something that synchronizes with us
+            ATOMIC_STORE_POINTER(shard.pages[page], entries);
+        }
+        Entry& entry = shard.pages[page][index % IRC_INTERN_PAGE_SIZE];
+        entry.text = irc_intern_empty;
+        entry.length = 0;
+        entry.references = 0;
+    }
+
+    Entry& entry = shard.pages[index / IRC_INTERN_PAGE_SIZE][index % IRC_INTERN_PAGE_SIZE];
+    if(slotClass > IRC_INTERN_SLOT_CLASSES)
+    {
+        // a name of its own, it goes with its entry
+        entry.text = (char*)malloc(length);
+        Unless(entry.text)
+            return IRC_SYMBOL_NONE;
+        shard.bytes += length;
+    }
+    else if(!reused && slotClass)
+    {
+        // a new entry, free ones keep their slot
+        size_t size = slotClass * IRC_INTERN_SLOT_SIZE;
+        if(size > shard.chunkLeft)
+        {
+            char* block = (char*)malloc(IRC_INTERN_CHUNK_SIZE);
+            Unless(block)
+                return IRC_SYMBOL_NONE;
+            shard.blocks.push_back(block);
+            shard.bytes += IRC_INTERN_CHUNK_SIZE;
+            shard.chunk = block;
+            shard.chunkLeft = IRC_INTERN_CHUNK_SIZE;
+        }
+        entry.text = shard.chunk;
+        shard.chunk += size;
+        shard.chunkLeft -= size;
+    }
+
+    if(index == shard.count)
+        shard.count++;
+    else
+        freeEntries.pop_back();
+    return index;
+}
+
+void IrcInternPool::_free(Shard& shard, unsigned int index)
+{
+    Entry& entry = shard.pages[index / IRC_INTERN_PAGE_SIZE][index % IRC_INTERN_PAGE_SIZE];
+    unsigned int hash = _hash(IrcStringView(entry.text, entry.length));
+    unsigned int* link = shard.index.find(hash);
+    if(*link == index)
+    {
+        if(entry.next == IRC_SYMBOL_NONE)
+            shard.index.erase(hash);
+        else
+            *link = entry.next;
+    }
+    else
+    {
+        for(unsigned int other = *link; other != IRC_SYMBOL_NONE; )
+        {
+            Entry& previous = shard.pages[other / IRC_INTERN_PAGE_SIZE][other % IRC_INTERN_PAGE_SIZE];
+            if(previous.next == index)
+            {
+                previous.next = entry.next;
+                break;
+            }
+            other = previous.next;
+        }
+    }
+
+    unsigned int slotClass = _slotClass(entry.length);
+    if(slotClass > IRC_INTERN_SLOT_CLASSES)
+    {
+        free(entry.text);
+        shard.bytes -= entry.length;
+        entry.text = irc_intern_empty;
+    }
+    entry.length = 0;
+    shard.freeEntries[slotClass].push_back(index);
+    shard.used--;
+}
+
+IrcSymbol IrcInternPool::intern(const IrcStringView& text)
+{
+    unsigned int hash = _hash(text);
+    // the hash picks the shard from its high bits, the index uses all of them
+    unsigned int shardIndex = (hash >> (32 - IRC_INTERN_SHARD_BITS)) & (IRC_INTERN_SHARDS - 1);
+    Shard& shard = _shards[shardIndex];
+    MutexHandle shardHandle(&shard.mutex);
+
+    unsigned int index = _find(shard, text, hash);
+    if(index != IRC_SYMBOL_NONE)
+    {
+        ATOMIC_INCREMENT(shard.pages[index / IRC_INTERN_PAGE_SIZE][index % IRC_INTERN_PAGE_SIZE].references);
+        return (index << IRC_INTERN_SHARD_BITS) | shardIndex;
+    }
+
+    index = _allocate(shard, text.size);
+    Unless(index != IRC_SYMBOL_NONE)
+        return IRC_SYMBOL_NONE;
+    Entry& entry = shard.pages[index / IRC_INTERN_PAGE_SIZE][index % IRC_INTERN_PAGE_SIZE];
+    memcpy(entry.text, text.data, text.size);
+    entry.length = (unsigned int)text.size;
+    const unsigned int* first = shard.index.find(hash);
+    entry.next = first ? *first : IRC_SYMBOL_NONE;
+    shard.index.set(hash, index);
+    entry.references = 1;
+    shard.used++;
+    return (index << IRC_INTERN_SHARD_BITS) | shardIndex;
+}
+
+void IrcInternPool::release(IrcSymbol symbol)
+{
+    Return_Void_Unless(symbol != IRC_SYMBOL_NONE);
+    Entry& entry = _entry(symbol);
+    // all but the last reference go without the lock, the last one has to keep intern(...)
+    // from handing out the symbol again while it goes
+    for(;;)
+    {
+        long references = entry.references;
+        if(references <= 1)
+            break;
+        if(ATOMIC_COMPARE_EXCHANGE(entry.references, references, references - 1) == references)
+            return;
+    }
+    Shard& shard = _shards[symbol & (IRC_INTERN_SHARDS - 1)];
+    MutexHandle shardHandle(&shard.mutex);
+    if(ATOMIC_DECREMENT(entry.references) == 0)
+        _free(shard, symbol >> IRC_INTERN_SHARD_BITS);
+}
+
+IrcSymbol IrcInternPool::intern(const IrcStringView& name, const IrcCaseMapping& mapping)
+{
+    if(name.size <= IRC_INTERN_FOLD_BUFFER)
+    {
+        char folded[IRC_INTERN_FOLD_BUFFER];
+        mapping.fold(name.data, name.size, folded);
+        return intern(IrcStringView(folded, name.size));
+    }
+    std::string folded = mapping.fold(name);
+    return intern(IrcStringView(folded.data(), folded.size()));
+}
+
+IrcSymbol IrcInternPool::find(const IrcStringView& text)
+{
+    unsigned int hash = _hash(text);
+    unsigned int shardIndex = (hash >> (32 - IRC_INTERN_SHARD_BITS)) & (IRC_INTERN_SHARDS - 1);
+    Shard& shard = _shards[shardIndex];
+    MutexHandle shardHandle(&shard.mutex);
+    unsigned int index = _find(shard, text, hash);
+    return index == IRC_SYMBOL_NONE ? IRC_SYMBOL_NONE : (index << IRC_INTERN_SHARD_BITS) | shardIndex;
+}
+
+size_t IrcInternPool::size()
+{
+    size_t count = 0;
+    for(unsigned int i = 0; i < IRC_INTERN_SHARDS; i++)
+    {
+        MutexHandle shardHandle(&_shards[i].mutex);
+        count += _shards[i].used;
+    }
+    return count;
+}
+
+size_t IrcInternPool::getMemoryUsage()
+{
+    size_t bytes = 0;
+    for(unsigned int i = 0; i < IRC_INTERN_SHARDS; i++)
+    {
+        MutexHandle shardHandle(&_shards[i].mutex);
+        bytes += _shards[i].bytes;
+    }
+    return bytes;
+}
@@ -0,0 +1,133 @@
+#ifndef _IRC_INTERN_POOL_H_
+#define _IRC_INTERN_POOL_H_
+#include <vector>
+#include <util/threadHelper.h>
+#include <util/openHashMap.h>
+#include <irc/ircMessage.h>
+#include <irc/ircCaseMapping.h>
+
+//ircInternPool.h
+//Author: Simon Wittenberg
+
+// Names known by a 32 bit symbol, shared by all connections and threads. The same text
+// always gets the same symbol, so names compare as integers and tables key by them
+// without a copy of the text.
+// Interning locks one of IRC_INTERN_SHARDS shards, picked by the hash of the text, so
+// threads rarely wait for each other. get(...) never locks, the text of a symbol does not
+// move and its entry is published before the symbol is handed out.
+// Symbols are reference counted, whoever interns or retains one releases it once done.
+// After the last release the symbol and its text are reused for another name, so the
+// pool holds about as much as is in use at once, e.g. the nicks of the channels we are in.
+
+typedef unsigned int IrcSymbol;
+#define IRC_SYMBOL_NONE ((IrcSymbol)-1)
+
+// a power of two, the low bits of a symbol are its shard
+#define IRC_INTERN_SHARD_BITS 4
+#define IRC_INTERN_SHARDS (1 << IRC_INTERN_SHARD_BITS)
+// entries per page and pages per shard, 16M symbols in all. Every shard has a page at
+// least, small pages keep that down for a connection that only sees a few channels
+#define IRC_INTERN_PAGE_SIZE 1024
+#define IRC_INTERN_MAX_PAGES 1024
+// text is stored in chunks of this size, in slots of a multiple of IRC_INTERN_SLOT_SIZE
+// bytes that are reused by names of the same size class. Names longer than the largest
+// class get a block of their own
+#define IRC_INTERN_CHUNK_SIZE 65536
+#define IRC_INTERN_SLOT_SIZE 8
+#define IRC_INTERN_SLOT_CLASSES 8
+
+class IrcInternPool
+{
+public:
+    IrcInternPool();
+    ~IrcInternPool();
+
+    // the pool the connections use
+    static IrcInternPool& global();
+
+    // the symbol of text with one more reference, IRC_SYMBOL_NONE if the pool is full
+    IrcSymbol intern(const IrcStringView& text);
+    // the symbol of name as mapping folds it, so names the server considers the same
+    // get the same symbol, e.g. "[Bot]" and "{bot}" with rfc1459
+    IrcSymbol intern(const IrcStringView& name, const IrcCaseMapping& mapping);
+    // the symbol of text if it is in use, IRC_SYMBOL_NONE otherwise. Takes no reference,
+    // the symbol only stays text's while someone else holds one
+    IrcSymbol find(const IrcStringView& text);
+
+    // another reference to a symbol the caller holds one of, doesn't lock
+    void retain(IrcSymbol symbol)
+    {
+        if(symbol != IRC_SYMBOL_NONE)
+            ATOMIC_INCREMENT(_entry(symbol).references);
+    };
+    // drops a reference, the symbol goes with the last one. Only that one locks
+    void release(IrcSymbol symbol);
+
+    // the text of a symbol the caller holds a reference to
+    IrcStringView get(IrcSymbol symbol) const
+    {
+        const Entry& entry = _entry(symbol);
+        return IrcStringView(entry.text, entry.length);
+    };
+
+    // how many symbols are in use
+    size_t size();
+    // bytes held for entries and text, without the index
+    size_t getMemoryUsage();
+
+private:
+    struct Entry
+    {
+        // a free entry keeps its slot, the size class it is filed under says how large it is
+        char*           text;
+        unsigned int    length;
+        // the next entry of the shard with the same hash, see Shard::index
+        unsigned int    next;
+        // 0 for free entries, the last reference only goes with the mutex of the shard held
+        irc_atomic_t    references;
+    };
+
+    struct Shard
+    {
+        IRC_MUTEX_HANDLE            mutex;
+        Entry* volatile             pages[IRC_INTERN_MAX_PAGES];
+        // entries handed out so far and how many of them are in use
+        unsigned int                count;
+        unsigned int                used;
+        // the hash of a text maps to the first entry with it
+        OpenHashMap<unsigned int>   index;
+        // free entries by the size class of their slot, see _slotClass(...)
+        std::vector<unsigned int>   freeEntries[IRC_INTERN_SLOT_CLASSES + 2];
+        char*                       chunk;
+        size_t                      chunkLeft;
+        std::vector<char*>          blocks;
+        size_t                      bytes;
+    };
+
+    const Entry& _entry(IrcSymbol symbol) const
+    {
+        const Shard& shard = _shards[symbol & (IRC_INTERN_SHARDS - 1)];
+        unsigned int index = symbol >> IRC_INTERN_SHARD_BITS;
+        const Entry* page = (const Entry*)ATOMIC_LOAD_POINTER(shard.pages[index / IRC_INTERN_PAGE_SIZE]);
+        return page[index % IRC_INTERN_PAGE_SIZE];
+    };
+    Entry& _entry(IrcSymbol symbol) { return const_cast<Entry&>(static_cast<const IrcInternPool*>(this)->_entry(symbol)); };
+
+    static unsigned int _hash(const IrcStringView& text);
+    // the size class of a name of length bytes, 0 for the empty one and
+    // IRC_INTERN_SLOT_CLASSES + 1 for those that get a block of their own
+    static unsigned int _slotClass(size_t length);
+    // the entry of text in shard, IRC_SYMBOL_NONE if there is none. Expects the mutex of
+    // the shard to be held
+    unsigned int _find(const Shard& shard, const IrcStringView& text, unsigned int hash) const;
+    // a free entry with room for length bytes, IRC_SYMBOL_NONE if the pool is full.
+    // Expects the mutex of the shard to be held
+    unsigned int _allocate(Shard& shard, size_t length);
+    // unlinks an entry that lost its last reference and keeps it for reuse. Expects the
+    // mutex of the shard to be held
+    void _free(Shard& shard, unsigned int index);
+
+    Shard   _shards[IRC_INTERN_SHARDS];
+};
+
+#endif //_IRC_INTERN_POOL_H_
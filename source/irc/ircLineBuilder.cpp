@@ -0,0 +1,75 @@
+#include "ircLineBuilder.h"
+#include <stdio.h>
+
+//ircLineBuilder.cpp
+//Author: Simon Wittenberg
+
+
+IrcLineBuilder::IrcLineBuilder(IrcConnection& connection, IrcLane lane/* = IRC_LANE_CHAT*/)
+:   _connection(connection),
+    _lane(lane),
+    _targetOffset(0),
+    _targetSize(0),
+    _limit(IRC_MAX_MESSAGE_LENGTH),
+    _size(0),
+    _overflowed(false)
+{
+}
+
+IrcLineBuilder::IrcLineBuilder(IrcConnection& connection, const char* command, const String& target, IrcLane lane/* = IRC_LANE_CHAT*/)
+:   _connection(connection),
+    _lane(lane),
+    _targetOffset(0),
+    _targetSize(0),
+    _limit(IRC_MAX_MESSAGE_LENGTH),
+    _size(0),
+    _overflowed(false)
+{
+    *this << command << ' ';
+    _targetOffset = _size;
+    *this << target;
+    _targetSize = _size - _targetOffset;
+    *this << " :";
+
+    size_t limit = _size + connection.getTextLimit(_size);
+    if(limit < _limit)
+        _limit = limit;
+}
+
+IrcLineBuilder& IrcLineBuilder::operator<<(const IrcStringView& text)
+{
+    size_t length = text.size;
+    if(_size + length > _limit)
+    {
+        length = _limit - _size;
+        // don't leave half a character behind, continuation bytes are 10xxxxxx
+        while(length > 0 && (text.data[length] & 0xC0) == 0x80)
+            length--;
+        _overflowed = true;
+    }
+    for(size_t i = 0; i < length; i++)
+    {
+        char c = text.data[i];
+        _buffer[_size++] = (c == '\r' || c == '\n' || c == '\0') ? ' ' : c;
+    }
+    return *this;
+}
+
+IrcLineBuilder& IrcLineBuilder::operator<<(int number)
+{
+    char text[16];
+    sprintf(text, "%d", number);
+    return *this << IrcStringView(text);
+}
+
+IrcLineBuilder& IrcLineBuilder::operator<<(unsigned int number)
+{
+    char text[16];
+    sprintf(text, "%u", number);
+    return *this << IrcStringView(text);
+}
+
+int IrcLineBuilder::send()
+{
+    return _connection.queueLine(_lane, String(_buffer + _targetOffset, _targetSize), String(_buffer, _size));
+}
@@ -0,0 +1,52 @@
+#ifndef _IRC_LINE_BUILDER_H_
+#define _IRC_LINE_BUILDER_H_
+#include <irc/ircConnection.h>
+
+//ircLineBuilder.h
+//Author: Simon Wittenberg
+
+// Builds a protocol line on the stack and queues it on a connection, instead of appending
+// String temporaries that are copied again on their way out:
+//
+//     (IrcLineBuilder(*this, "PRIVMSG", channel) << "@" << nick << ", My Cue!").send();
+//
+// It never grows past what the server relays, for messages and notices that is the 510
+// bytes minus the prefix the server puts in front. Whatever doesn't fit is cut off at an
+// utf-8 character boundary and overflowed() tells, sendMessage(...) is the one that splits.
+// Line breaks would end the line early, they are written as spaces.
+
+class IrcLineBuilder
+{
+public:
+    // a line of its own, e.g. IrcLineBuilder(connection, IRC_LANE_CONTROL) << "MODE " << channel << " +o " << nick
+    IrcLineBuilder(IrcConnection& connection, IrcLane lane = IRC_LANE_CHAT);
+    // "COMMAND target :", what follows is the text
+    IrcLineBuilder(IrcConnection& connection, const char* command, const String& target, IrcLane lane = IRC_LANE_CHAT);
+
+    IrcLineBuilder& operator<<(const IrcStringView& text);
+    IrcLineBuilder& operator<<(const char* text){ return *this << IrcStringView(text); };
+    IrcLineBuilder& operator<<(const String& text){ return *this << IrcStringView(text.data(), text.size()); };
+    IrcLineBuilder& operator<<(char c){ return *this << IrcStringView(&c, 1); };
+    IrcLineBuilder& operator<<(int number);
+    IrcLineBuilder& operator<<(unsigned int number);
+
+    // queues the line, returns 0 on success
+    int send();
+
+    // true if something was cut off
+    bool overflowed() const { return _overflowed; };
+    IrcStringView view() const { return IrcStringView(_buffer, _size); };
+
+private:
+    IrcConnection&  _connection;
+    IrcLane         _lane;
+    // the flood control queue the line goes to, inside _buffer
+    size_t          _targetOffset;
+    size_t          _targetSize;
+    size_t          _limit;
+    size_t          _size;
+    bool            _overflowed;
+    char            _buffer[IRC_MAX_MESSAGE_LENGTH];
+};
+
+#endif //_IRC_LINE_BUILDER_H_
@@ -0,0 +1,381 @@
+#include "ircMaskSet.h"
+
+//ircMaskSet.cpp
+//Author: Simon Wittenberg
+
+
+static bool irc_is_wild(char c)
+{
+    return c == '*' || c == '?';
+}
+
+void IrcMaskSet::setCaseMapping(const IrcCaseMapping& mapping)
+{
+    Return_Void_Unless(mapping != _mapping);
+    _mapping = mapping;
+    // every hash changes with the mapping
+    for(unsigned int i = 0; i < INDEX_COUNT; i++)
+        _indexes[i].clear();
+    _generic.clear();
+    _all.clear();
+    for(unsigned int id = 0; id < _masks.size(); id++)
+    {
+        Mask& mask = _masks[id];
+        if(mask.text.empty())
+            continue;
+        mask.keyHash = _mapping.hash(_key(mask));
+        mask.hash = _mapping.hash(IrcStringView(mask.text.data(), mask.text.size()));
+        _link(id);
+    }
+}
+
+std::string IrcMaskSet::_complete(const IrcStringView& mask)
+{
+    const char* begin = mask.data;
+    const char* end = mask.data + mask.size;
+    const char* bang = begin;
+    while(bang < end && *bang != '!' && *bang != '@')
+        bang++;
+    const char* at = bang;
+    while(at < end && *at != '@')
+        at++;
+
+    IrcStringView nick(begin, bang - begin);
+    IrcStringView user;
+    IrcStringView host;
+    if(bang < end && *bang == '@')
+    {
+        // "user@host"
+        user = nick;
+        nick = IrcStringView();
+    }
+    else if(bang < at)
+        user = IrcStringView(bang + 1, at - bang - 1);
+    if(at < end)
+        host = IrcStringView(at + 1, end - at - 1);
+
+    std::string text;
+    text.reserve(nick.size + user.size + host.size + 2);
+    text.append(nick.size ? std::string(nick.data, nick.size) : "*");
+    text += '!';
+    text.append(user.size ? std::string(user.data, user.size) : "*");
+    text += '@';
+    text.append(host.size ? std::string(host.data, host.size) : "*");
+    return text;
+}
+
+void IrcMaskSet::_classify(Mask& mask) const
+{
+    IrcStringView nick = _nick(mask);
+    IrcStringView host = _host(mask);
+    size_t first = host.size;
+    size_t last = host.size;
+    for(size_t i = 0; i < host.size; i++)
+    {
+        if(irc_is_wild(host[i]))
+        {
+            if(first == host.size)
+                first = i;
+            last = i;
+        }
+    }
+
+    mask.index = INDEX_NONE;
+    mask.keyOffset = 0;
+    mask.keyLength = 0;
+    if(first == host.size)
+    {
+        mask.index = INDEX_HOST;
+        mask.keyOffset = mask.hostOffset;
+        mask.keyLength = (unsigned int)host.size;
+    }
+    else
+    {
+        // the literal tail from its first dot on, ".example.org" of "*foo.example.org"
+        size_t suffix = last + 1;
+        while(suffix < host.size && host[suffix] != '.')
+            suffix++;
+        size_t suffixLength = host.size - suffix;
+        // the literal head up to its last dot, "192.168." of "192.168.1*"
+        size_t prefixLength = first;
+        while(prefixLength && host[prefixLength - 1] != '.')
+            prefixLength--;
+
+        // a lone dot tells nothing
+        if(suffixLength > 1 && suffixLength >= prefixLength)
+        {
+            mask.index = INDEX_SUFFIX;
+            mask.keyOffset = mask.hostOffset + (unsigned int)suffix;
+            mask.keyLength = (unsigned int)suffixLength;
+        }
+        else if(prefixLength > 1)
+        {
+            mask.index = INDEX_PREFIX;
+            mask.keyOffset = mask.hostOffset;
+            mask.keyLength = (unsigned int)prefixLength;
+        }
+    }
+    if(mask.index == INDEX_NONE)
+    {
+        bool wild = false;
+        for(size_t i = 0; i < nick.size && !wild; i++)
+            wild = irc_is_wild(nick[i]);
+        if(!wild)
+        {
+            mask.index = INDEX_NICK;
+            mask.keyLength = (unsigned int)nick.size;
+        }
+    }
+    mask.keyHash = _mapping.hash(_key(mask));
+}
+
+void IrcMaskSet::_link(unsigned int id)
+{
+    Mask& mask = _masks[id];
+    if(mask.index == INDEX_NONE)
+    {
+        mask.next = IRC_MASK_NONE;
+        mask.genericSlot = (unsigned int)_generic.size();
+        _generic.push_back(id);
+    }
+    else
+    {
+        OpenHashMap<unsigned int>& index = _indexes[mask.index];
+        const unsigned int* first = index.find(mask.keyHash);
+        mask.next = first ? *first : IRC_MASK_NONE;
+        index.set(mask.keyHash, id);
+    }
+    const unsigned int* same = _all.find(mask.hash);
+    mask.nextSame = same ? *same : IRC_MASK_NONE;
+    _all.set(mask.hash, id);
+}
+
+void IrcMaskSet::_unlink(unsigned int id)
+{
+    Mask& mask = _masks[id];
+    if(mask.index == INDEX_NONE)
+    {
+        unsigned int moved = _generic.back();
+        _generic[mask.genericSlot] = moved;
+        _masks[moved].genericSlot = mask.genericSlot;
+        _generic.pop_back();
+    }
+    else
+    {
+        OpenHashMap<unsigned int>& index = _indexes[mask.index];
+        unsigned int* at = index.find(mask.keyHash);
+        if(*at == id)
+        {
+            if(mask.next == IRC_MASK_NONE)
+                index.erase(mask.keyHash);
+            else
+                *at = mask.next;
+        }
+        else
+        {
+            unsigned int previous = *at;
+            while(_masks[previous].next != id)
+                previous = _masks[previous].next;
+            _masks[previous].next = mask.next;
+        }
+    }
+
+    unsigned int* at = _all.find(mask.hash);
+    if(*at == id)
+    {
+        if(mask.nextSame == IRC_MASK_NONE)
+            _all.erase(mask.hash);
+        else
+            *at = mask.nextSame;
+    }
+    else
+    {
+        unsigned int previous = *at;
+        while(_masks[previous].nextSame != id)
+            previous = _masks[previous].nextSame;
+        _masks[previous].nextSame = mask.nextSame;
+    }
+}
+
+unsigned int IrcMaskSet::find(const IrcStringView& mask) const
+{
+    std::string text = _complete(mask);
+    IrcStringView view(text.data(), text.size());
+    const unsigned int* first = _all.find(_mapping.hash(view));
+    for(unsigned int id = first ? *first : IRC_MASK_NONE; id != IRC_MASK_NONE; id = _masks[id].nextSame)
+        if(_mapping.equals(_masks[id].text, view))
+            return id;
+    return IRC_MASK_NONE;
+}
+
+unsigned int IrcMaskSet::add(const IrcStringView& mask)
+{
+    unsigned int id = find(mask);
+    if(id != IRC_MASK_NONE)
+        return id;
+
+    if(_free.empty())
+    {
+        id = (unsigned int)_masks.size();
+        _masks.push_back(Mask());
+    }
+    else
+    {
+        id = _free.back();
+        _free.pop_back();
+    }
+    Mask& added = _masks[id];
+    added.text = _complete(mask);
+    added.userOffset = (unsigned int)added.text.find('!') + 1;
+    added.hostOffset = (unsigned int)added.text.find('@', added.userOffset) + 1;
+    added.hash = _mapping.hash(IrcStringView(added.text.data(), added.text.size()));
+    _classify(added);
+    _link(id);
+    _size++;
+    return id;
+}
+
+bool IrcMaskSet::remove(unsigned int id)
+{
+    Return_False_Unless(id < _masks.size() && !_masks[id].text.empty());
+    _unlink(id);
+    std::string().swap(_masks[id].text);
+    _free.push_back(id);
+    _size--;
+    return true;
+}
+
+bool IrcMaskSet::remove(const IrcStringView& mask)
+{
+    unsigned int id = find(mask);
+    Return_False_Unless(id != IRC_MASK_NONE);
+    return remove(id);
+}
+
+void IrcMaskSet::clear()
+{
+    for(unsigned int i = 0; i < INDEX_COUNT; i++)
+        _indexes[i].clear();
+    _generic.clear();
+    _all.clear();
+    _masks.clear();
+    _free.clear();
+    _size = 0;
+}
+
+bool IrcMaskSet::_glob(const IrcStringView& pattern, const IrcStringView& text) const
+{
+    // on a mismatch go back to the last '*' and let it take one more character
+    size_t p = 0;
+    size_t t = 0;
+    size_t star = IrcStringView::npos;
+    size_t mark = 0;
+    while(t < text.size)
+    {
+        if(p < pattern.size && pattern[p] == '*')
+        {
+            // a trailing '*' takes the rest, as in the "*" parts of most masks
+            if(++p == pattern.size)
+                return true;
+            star = p - 1;
+            mark = t;
+        }
+        else if(p < pattern.size && (pattern[p] == '?' || _mapping.fold(pattern[p]) == _mapping.fold(text[t])))
+        {
+            p++;
+            t++;
+        }
+        else if(star != IrcStringView::npos)
+        {
+            p = star + 1;
+            t = ++mark;
+        }
+        else
+            return false;
+    }
+    while(p < pattern.size && pattern[p] == '*')
+        p++;
+    return p == pattern.size;
+}
+
+bool IrcMaskSet::_matches(const Mask& mask, const IrcPrefix& who) const
+{
+    return _glob(_host(mask), who.host) && _glob(_nick(mask), who.nick) && _glob(_user(mask), who.user);
+}
+
+size_t IrcMaskSet::_matchKey(Index index, const IrcStringView& key, const IrcPrefix& who, std::vector<unsigned int>* ids, unsigned int* id) const
+{
+    const unsigned int* first = _indexes[index].find(_mapping.hash(key));
+    size_t count = 0;
+    for(unsigned int candidate = first ? *first : IRC_MASK_NONE; candidate != IRC_MASK_NONE; candidate = _masks[candidate].next)
+    {
+        const Mask& mask = _masks[candidate];
+        // masks with another key that happens to hash the same share the chain
+        if(!_mapping.equals(_key(mask), key) || !_matches(mask, who))
+            continue;
+        count++;
+        if(id)
+            *id = candidate;
+        Unless(ids)
+            return count;
+        ids->push_back(candidate);
+    }
+    return count;
+}
+
+size_t IrcMaskSet::_match(const IrcPrefix& who, std::vector<unsigned int>* ids, unsigned int* id) const
+{
+    // ids == NULL stops at the first match
+    size_t count = 0;
+    const IrcStringView& host = who.host;
+    if(host.size)
+    {
+        if(!_indexes[INDEX_HOST].empty())
+        {
+            count += _matchKey(INDEX_HOST, host, who, ids, id);
+            if(count && !ids)
+                return count;
+        }
+        bool suffixes = !_indexes[INDEX_SUFFIX].empty();
+        bool prefixes = !_indexes[INDEX_PREFIX].empty();
+        for(size_t i = 0; i < host.size && (suffixes || prefixes); i++)
+        {
+            if(host[i] != '.')
+                continue;
+            if(suffixes)
+                count += _matchKey(INDEX_SUFFIX, IrcStringView(host.data + i, host.size - i), who, ids, id);
+            if(prefixes)
+                count += _matchKey(INDEX_PREFIX, IrcStringView(host.data, i + 1), who, ids, id);
+            if(count && !ids)
+                return count;
+        }
+    }
+    if(!_indexes[INDEX_NICK].empty())
+    {
+        count += _matchKey(INDEX_NICK, who.nick, who, ids, id);
+        if(count && !ids)
+            return count;
+    }
+    for(size_t i = 0; i < _generic.size(); i++)
+    {
+        Unless(_matches(_masks[_generic[i]], who))
+            continue;
+        count++;
+        if(id)
+            *id = _generic[i];
+        Unless(ids)
+            return count;
+        ids->push_back(_generic[i]);
+    }
+    return count;
+}
+
+bool IrcMaskSet::matches(const IrcPrefix& who, unsigned int* id) const
+{
+    return _match(who, NULL, id) != 0;
+}
+
+size_t IrcMaskSet::matchAll(const IrcPrefix& who, std::vector<unsigned int>* ids) const
+{
+    return _match(who, ids, NULL);
+}
@@ -0,0 +1,115 @@
+#ifndef _IRC_MASK_SET_H_
+#define _IRC_MASK_SET_H_
+#include <string>
+#include <vector>
+#include <util/util.h>
+#include <util/openHashMap.h>
+#include <irc/ircMessage.h>
+#include <irc/ircCaseMapping.h>
+
+//ircMaskSet.h
+//Author: Simon Wittenberg
+
+// A set of hostmasks like "*!*@*.example.org" to match "nick!user@host" against, for
+// ban, ignore and access lists with many thousands of entries.
+// Every mask is indexed by the most telling literal part it has:
+//      "*!*@host.example.org"      the whole host
+//      "*!*@*.example.org"         a host suffix starting at a dot
+//      "*!*@192.168.*"             a host prefix ending at a dot
+//      "nick!*@*"                  the whole nick
+// A lookup hashes the host once per dot it has and the nick, only the masks found that way
+// are matched for real. Masks that have nothing to index, e.g. "*!*bot*@*", are always
+// matched, so the set stays fast as long as there are few of those.
+// Names compare as the server's CASEMAPPING says, '*' matches any number of characters and
+// '?' a single one. Not thread safe.
+
+#define IRC_MASK_NONE ((unsigned int)-1)
+
+class IrcMaskSet
+{
+public:
+    IrcMaskSet() : _size(0) {};
+
+    void setCaseMapping(const IrcCaseMapping& mapping);
+
+    // adds a mask, "nick", "nick!user" and "user@host" are completed with "*" parts.
+    // Returns its id, the id it already had if an equal mask is in the set
+    unsigned int add(const IrcStringView& mask);
+    // returns false if the mask wasn't in the set
+    bool remove(const IrcStringView& mask);
+    bool remove(unsigned int id);
+    // the id of an equal mask, IRC_MASK_NONE if there is none
+    unsigned int find(const IrcStringView& mask) const;
+    void clear();
+
+    // the mask of id as it was completed
+    const std::string& getMask(unsigned int id) const { return _masks[id].text; };
+    size_t size() const { return _size; };
+
+    // whether any mask matches who, the id of one of them goes to id
+    bool matches(const IrcPrefix& who, unsigned int* id = NULL) const;
+    bool matches(const IrcStringView& prefix, unsigned int* id = NULL) const { return matches(IrcPrefix(prefix), id); };
+    // appends the ids of all masks that match who, returns how many there were
+    size_t matchAll(const IrcPrefix& who, std::vector<unsigned int>* ids) const;
+
+private:
+    enum Index
+    {
+        INDEX_HOST = 0,
+        INDEX_SUFFIX,
+        INDEX_PREFIX,
+        INDEX_NICK,
+        INDEX_COUNT,
+        // the rest, in _generic
+        INDEX_NONE = INDEX_COUNT
+    };
+
+    struct Mask
+    {
+        // "nick!user@host", empty for free ids
+        std::string     text;
+        unsigned int    userOffset;
+        unsigned int    hostOffset;
+        // the part of text the mask is indexed by
+        Index           index;
+        unsigned int    keyOffset;
+        unsigned int    keyLength;
+        unsigned int    keyHash;
+        // the next mask with the same key hash
+        unsigned int    next;
+        // the hash of the whole mask and the next mask with the same, see _all
+        unsigned int    hash;
+        unsigned int    nextSame;
+        // where the mask is in _generic
+        unsigned int    genericSlot;
+    };
+
+    IrcStringView _nick(const Mask& mask) const { return IrcStringView(mask.text.data(), mask.userOffset - 1); };
+    IrcStringView _user(const Mask& mask) const { return IrcStringView(mask.text.data() + mask.userOffset, mask.hostOffset - 1 - mask.userOffset); };
+    IrcStringView _host(const Mask& mask) const { return IrcStringView(mask.text.data() + mask.hostOffset, mask.text.size() - mask.hostOffset); };
+    IrcStringView _key(const Mask& mask) const { return IrcStringView(mask.text.data() + mask.keyOffset, mask.keyLength); };
+
+    static std::string _complete(const IrcStringView& mask);
+    // picks the index of a mask and its key
+    void _classify(Mask& mask) const;
+    void _link(unsigned int id);
+    void _unlink(unsigned int id);
+    bool _glob(const IrcStringView& pattern, const IrcStringView& text) const;
+    bool _matches(const Mask& mask, const IrcPrefix& who) const;
+    // calls _matches(...) for the masks with key in index, stops at the first match unless
+    // ids is given. Returns how many matched
+    size_t _matchKey(Index index, const IrcStringView& key, const IrcPrefix& who, std::vector<unsigned int>* ids, unsigned int* id) const;
+    size_t _match(const IrcPrefix& who, std::vector<unsigned int>* ids, unsigned int* id) const;
+
+    IrcCaseMapping              _mapping;
+    std::vector<Mask>           _masks;
+    std::vector<unsigned int>   _free;
+    size_t                      _size;
+    // the key hash of a mask maps to the first mask with it
+    OpenHashMap<unsigned int>   _indexes[INDEX_COUNT];
+    std::vector<unsigned int>   _generic;
+    // the hash of every whole mask, to find equal ones
+    OpenHashMap<unsigned int>   _all;
+};
+
+#endif //_IRC_MASK_SET_H_
@@ -0,0 +1,172 @@
+#ifndef _IRC_MESSAGE_H_
+#define _IRC_MESSAGE_H_
+#include <string>
+#include <string.h>
+
+//ircMessage.h
+//Author: Simon Wittenberg
+
+// Non owning views of a received irc message. They point straight into the buffer the
+// message was received in and are only valid for the duration of the callback they
+// are handed to, copy what you need to keep (e.g. with IrcStringView::toString()).
+
+// the most params a single message may carry, 15 as of RFC 2812
+#define IRC_MAX_PARAMS 15
+
+// the longest message a server relays, without its line end (RFC 1459)
+#define IRC_MAX_MESSAGE_LENGTH 510
+
+struct IrcStringView
+{
+    const char*     data;
+    size_t          size;
+
+    IrcStringView() : data(""), size(0) {}
+    IrcStringView(const char* str) : data(str ? str : ""), size(str ? strlen(str) : 0) {}
+    IrcStringView(const char* str, size_t len) : data(str), size(len) {}
+
+    bool empty() const { return size == 0; }
+    char operator[](size_t index) const { return data[index]; }
+
+    bool equals(const IrcStringView& other) const
+    {
+        return size == other.size && memcmp(data, other.data, size) == 0;
+    }
+    bool equals(const char* str) const { return equals(IrcStringView(str)); }
+    bool startsWith(const char* str) const
+    {
+        size_t len = strlen(str);
+        return size >= len && memcmp(data, str, len) == 0;
+    }
+
+    // returns the index of the first occurrence of needle or npos
+    size_t find(const char* needle) const
+    {
+        size_t len = strlen(needle);
+        if(len == 0)
+            return 0;
+        for(size_t i = 0; i + len <= size; i++)
+            if(data[i] == needle[0] && memcmp(data + i, needle, len) == 0)
+                return i;
+        return npos;
+    }
+
+    // the only operation that allocates
+    std::string toString() const { return std::string(data, size); }
+
+    static const size_t npos = (size_t)-1;
+};
+
+// the commands the parser knows by name, see IrcParser::lookupCommand(...)
+enum IrcCommand
+{
+    IRC_COMMAND_UNKNOWN = 0,
+    IRC_COMMAND_NUMERIC,
+    IRC_COMMAND_PRIVMSG,
+    IRC_COMMAND_NOTICE,
+    IRC_COMMAND_JOIN,
+    IRC_COMMAND_PART,
+    IRC_COMMAND_QUIT,
+    IRC_COMMAND_NICK,
+    IRC_COMMAND_MODE,
+    IRC_COMMAND_TOPIC,
+    IRC_COMMAND_KICK,
+    IRC_COMMAND_INVITE,
+    IRC_COMMAND_PING,
+    IRC_COMMAND_PONG,
+    IRC_COMMAND_ERROR,
+    IRC_COMMAND_KILL,
+    IRC_COMMAND_CAP,
+    IRC_COMMAND_AUTHENTICATE,
+    IRC_COMMAND_ACCOUNT,
+    IRC_COMMAND_AWAY,
+    IRC_COMMAND_CHGHOST,
+    IRC_COMMAND_BATCH,
+    IRC_COMMAND_TAGMSG,
+    IRC_COMMAND_WALLOPS,
+    IRC_COMMAND_SETNAME,
+    IRC_COMMAND_COUNT
+};
+
+// the parts of a message prefix "nick!user@host", a server name ends up in nick
+struct IrcPrefix
+{
+    IrcStringView   nick;
+    IrcStringView   user;
+    IrcStringView   host;
+
+    IrcPrefix() {}
+    explicit IrcPrefix(const IrcStringView& prefix)
+    {
+        const char* end = prefix.data + prefix.size;
+        const char* bang = prefix.data;
+        while(bang < end && *bang != '!' && *bang != '@')
+            bang++;
+        const char* at = bang;
+        while(at < end && *at != '@')
+            at++;
+
+        nick = IrcStringView(prefix.data, bang - prefix.data);
+        if(bang < at)
+            user = IrcStringView(bang + 1, at - bang - 1);
+        if(at < end)
+            host = IrcStringView(at + 1, end - at - 1);
+    }
+};
+
+enum IrcEventType
+{
+    IRC_EVENT_CONNECT = 0,
+    IRC_EVENT_NICK,
+    IRC_EVENT_QUIT,
+    IRC_EVENT_JOIN,
+    IRC_EVENT_PART,
+    IRC_EVENT_MODE,
+    IRC_EVENT_UMODE,
+    IRC_EVENT_TOPIC,
+    IRC_EVENT_KICK,
+    IRC_EVENT_CHANNEL,
+    IRC_EVENT_PRIVMSG,
+    IRC_EVENT_NOTICE,
+    IRC_EVENT_CHANNEL_NOTICE,
+    IRC_EVENT_INVITE,
+    IRC_EVENT_CTCP_REQ,
+    IRC_EVENT_CTCP_REP,
+    IRC_EVENT_CTCP_ACTION,
+    IRC_EVENT_UNKNOWN,
+    IRC_EVENT_NUMERIC,
+    IRC_EVENT_COUNT
+};
+
+// interest masks for IrcConnection::setEventMask(...)
+#define IRC_EVENT_BIT(type)         (1u << (type))
+#define IRC_EVENT_MASK_ALL          ((1u << IRC_EVENT_COUNT) - 1)
+// connect and unknown events are needed by IrcConnection itself and can not be masked
+#define IRC_EVENT_MASK_REQUIRED     (IRC_EVENT_BIT(IRC_EVENT_CONNECT) | IRC_EVENT_BIT(IRC_EVENT_UNKNOWN))
+// events IrcConnection follows itself (our nick and prefix, RPL_ISUPPORT, ...), libirc always
+// hands them to us, they are only passed on if they are in the mask as well
+#define IRC_EVENT_MASK_TRACKED      (IRC_EVENT_BIT(IRC_EVENT_NICK) | IRC_EVENT_BIT(IRC_EVENT_JOIN) | IRC_EVENT_BIT(IRC_EVENT_NUMERIC))
+// the other events the channel state is built from, see IrcConnection::setStateTracking(...)
+#define IRC_EVENT_MASK_STATE        (IRC_EVENT_BIT(IRC_EVENT_PART) | IRC_EVENT_BIT(IRC_EVENT_QUIT) | IRC_EVENT_BIT(IRC_EVENT_KICK) | IRC_EVENT_BIT(IRC_EVENT_MODE))
+
+struct IrcMessageView
+{
+    IrcEventType    type;
+    IrcStringView   event;      // the command, e.g. "PRIVMSG", or the numeric as text
+    IrcCommand      command;    // the command the event was raised for
+    IrcStringView   origin;     // the full prefix of the sender, "nick!user@host" or a server name
+    IrcPrefix       prefix;     // origin split into its parts
+    IrcStringView   params[IRC_MAX_PARAMS];
+    unsigned int    count;
+    unsigned int    numeric;    // only set for IRC_EVENT_NUMERIC
+
+    IrcMessageView() : type(IRC_EVENT_UNKNOWN), command(IRC_COMMAND_UNKNOWN), count(0), numeric(0) {}
+
+    // returns an empty view for missing params, so handlers need not check count
+    IrcStringView param(unsigned int index) const
+    {
+        return index < count ? params[index] : IrcStringView();
+    }
+};
+
+#endif //_IRC_MESSAGE_H_
@@ -0,0 +1,114 @@
+#include "ircModeBatcher.h"
+
+//ircModeBatcher.cpp
+//Author: Simon Wittenberg
+
+
+IrcModeBatcher::IrcModeBatcher()
+{
+    _delay = IRC_MODE_BATCH_DELAY;
+}
+
+void IrcModeBatcher::push(const std::string& channel, char sign, char mode, const std::string& param, millis_t now)
+{
+    IrcStringView name(channel.data(), channel.size());
+    size_t index = 0;
+    while(index < _batches.size() && !_mapping.equals(_batches[index].channel, name))
+        index++;
+    if(index == _batches.size())
+    {
+        _batches.push_back(Batch());
+        Batch& started = _batches.back();
+        started.channel = channel;
+        started.withParam = 0;
+        started.due = now + _delay;
+    }
+    Batch& batch = _batches[index];
+    Change change;
+    change.sign = sign == '-' ? '-' : '+';
+    change.mode = mode;
+    change.param = param;
+    batch.changes.push_back(change);
+    if(param.size())
+        batch.withParam++;
+}
+
+millis_t IrcModeBatcher::flush(millis_t now, unsigned int modes, size_t lineLimit, IrcFloodControl* out)
+{
+    if(modes == 0)
+        modes = 1;
+    millis_t next = 0;
+    std::vector<Batch>::iterator i = _batches.begin();
+    while(i != _batches.end())
+    {
+        Batch& batch = *i;
+        if(batch.due <= now)
+        {
+            _emit(batch, batch.changes.size(), modes, lineLimit, out, now);
+            i = _batches.erase(i);
+            continue;
+        }
+        // full lines go out right away, the rest keeps waiting for company
+        if(batch.withParam >= modes)
+        {
+            size_t count = 0;
+            unsigned int withParam = 0;
+            unsigned int full = batch.withParam - batch.withParam % modes;
+            while(count < batch.changes.size() && withParam < full)
+            {
+                if(batch.changes[count].param.size())
+                    withParam++;
+                count++;
+            }
+            _emit(batch, count, modes, lineLimit, out, now);
+            batch.changes.erase(batch.changes.begin(), batch.changes.begin() + count);
+            batch.withParam -= withParam;
+            if(batch.changes.empty())
+            {
+                i = _batches.erase(i);
+                continue;
+            }
+        }
+        if(!next || batch.due < next)
+            next = batch.due;
+        ++i;
+    }
+    return next;
+}
+
+void IrcModeBatcher::_emit(Batch& batch, size_t count, unsigned int modes, size_t lineLimit, IrcFloodControl* out, millis_t now)
+{
+    size_t index = 0;
+    while(index < count)
+    {
+        // "MODE #chan " + "+oo-v" + " a b c"
+        std::string flags;
+        std::string params;
+        const size_t fixed = 5 + batch.channel.size() + 1;
+        unsigned int withParam = 0;
+        char sign = 0;
+        for(; index < count; index++)
+        {
+            const Change& change = batch.changes[index];
+            size_t grow = (change.sign != sign ? 2 : 1) + (change.param.size() ? 1 + change.param.size() : 0);
+            bool full = change.param.size() && withParam == modes;
+            // a single change too long for any line still goes out on its own
+            if(flags.size() && (full || fixed + flags.size() + params.size() + grow > lineLimit))
+                break;
+            if(change.sign != sign)
+            {
+                sign = change.sign;
+                flags.append(1, sign);
+            }
+            flags.append(1, change.mode);
+            if(change.param.size())
+            {
+                params.append(" ").append(change.param);
+                withParam++;
+            }
+        }
+        std::string line("MODE ");
+        line.append(batch.channel).append(" ").append(flags).append(params);
+        out->push(batch.channel, line, now);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef _IRC_MODE_BATCHER_H_
+#define _IRC_MODE_BATCHER_H_
+#include <string>
+#include <vector>
+#include <util/threadHelper.h>
+#include <irc/ircFloodControl.h>
+#include <irc/ircCaseMapping.h>
+
+//ircModeBatcher.h
+//Author: Simon Wittenberg
+
+// Collects mode changes per channel and sends them as combined lines, "MODE #chan +oo-v a b c",
+// instead of a line (and a hit on the flood budget) per change. A channel's changes go out
+// once the oldest of them waited the delay, or right away once there are as many changes
+// with a parameter as the server takes in one line (MODES in RPL_ISUPPORT).
+// Not thread safe, IrcConnection guards it with its inner mutex.
+
+// how long a change waits for others to join it, in ms
+#define IRC_MODE_BATCH_DELAY    100
+
+class IrcModeBatcher
+{
+public:
+    IrcModeBatcher();
+
+    void setDelay(millis_t delay){ _delay = delay; };
+    // which channel names are the same batch, "#Chan" and "#chan" are unless set otherwise
+    void setCaseMapping(const IrcCaseMapping& mapping){ _mapping = mapping; };
+
+    // queues a change, e.g. '+', 'o', "nick". param is empty for modes without one
+    void push(const std::string& channel, char sign, char mode, const std::string& param, millis_t now);
+
+    // hands the lines of the batches that are due or full to out
+    // params:
+    // unsigned int modes   - changes with a parameter per line
+    // size_t lineLimit     - the longest line the server takes
+    // return:              when the next batch is due, 0 if none is waiting
+    millis_t flush(millis_t now, unsigned int modes, size_t lineLimit, IrcFloodControl* out);
+
+    // drops everything that is waiting
+    void clear(){ _batches.clear(); };
+    bool empty() const { return _batches.empty(); };
+
+private:
+    struct Change
+    {
+        char            sign;
+        char            mode;
+        std::string     param;
+    };
+
+    struct Batch
+    {
+        std::string         channel;
+        std::vector<Change> changes;
+        unsigned int        withParam;
+        millis_t            due;
+    };
+
+    // sends changes [0, count) of batch, as many lines as it takes
+    void _emit(Batch& batch, size_t count, unsigned int modes, size_t lineLimit, IrcFloodControl* out, millis_t now);
+
+    // in the order they were started, only a few channels ever wait at the same time
+    std::vector<Batch>              _batches;
+    millis_t                        _delay;
+    IrcCaseMapping                  _mapping;
+};
+
+#endif //_IRC_MODE_BATCHER_H_
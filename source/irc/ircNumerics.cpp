@@ -0,0 +1,150 @@
+#include "ircNumerics.h"
+#include <stddef.h>
+#include <libirc_rfcnumeric.h>
+
+//ircNumerics.cpp
+//Author: Simon Wittenberg
+
+// One case per numeric of libirc_rfcnumeric.h, the compiler turns this into a jump table.
+const char* irc_numeric_name(unsigned int numeric)
+{
+    switch(numeric)
+    {
+    case LIBIRC_RFC_RPL_WELCOME:              return "RPL_WELCOME";
+    case LIBIRC_RFC_RPL_YOURHOST:             return "RPL_YOURHOST";
+    case LIBIRC_RFC_RPL_CREATED:              return "RPL_CREATED";
+    case LIBIRC_RFC_RPL_MYINFO:               return "RPL_MYINFO";
+    case LIBIRC_RFC_RPL_BOUNCE:               return "RPL_BOUNCE";
+    case LIBIRC_RFC_RPL_TRACELINK:            return "RPL_TRACELINK";
+    case LIBIRC_RFC_RPL_TRACECONNECTING:      return "RPL_TRACECONNECTING";
+    case LIBIRC_RFC_RPL_TRACEHANDSHAKE:       return "RPL_TRACEHANDSHAKE";
+    case LIBIRC_RFC_RPL_TRACEUNKNOWN:         return "RPL_TRACEUNKNOWN";
+    case LIBIRC_RFC_RPL_TRACEOPERATOR:        return "RPL_TRACEOPERATOR";
+    case LIBIRC_RFC_RPL_TRACEUSER:            return "RPL_TRACEUSER";
+    case LIBIRC_RFC_RPL_TRACESERVER:          return "RPL_TRACESERVER";
+    case LIBIRC_RFC_RPL_TRACESERVICE:         return "RPL_TRACESERVICE";
+    case LIBIRC_RFC_RPL_TRACENEWTYPE:         return "RPL_TRACENEWTYPE";
+    case LIBIRC_RFC_RPL_TRACECLASS:           return "RPL_TRACECLASS";
+    case LIBIRC_RFC_RPL_STATSLINKINFO:        return "RPL_STATSLINKINFO";
+    case LIBIRC_RFC_RPL_STATSCOMMANDS:        return "RPL_STATSCOMMANDS";
+    case LIBIRC_RFC_RPL_ENDOFSTATS:           return "RPL_ENDOFSTATS";
+    case LIBIRC_RFC_RPL_UMODEIS:              return "RPL_UMODEIS";
+    case LIBIRC_RFC_RPL_SERVLIST:             return "RPL_SERVLIST";
+    case LIBIRC_RFC_RPL_SERVLISTEND:          return "RPL_SERVLISTEND";
+    case LIBIRC_RFC_RPL_STATSUPTIME:          return "RPL_STATSUPTIME";
+    case LIBIRC_RFC_RPL_STATSOLINE:           return "RPL_STATSOLINE";
+    case LIBIRC_RFC_RPL_LUSERCLIENT:          return "RPL_LUSERCLIENT";
+    case LIBIRC_RFC_RPL_LUSEROP:              return "RPL_LUSEROP";
+    case LIBIRC_RFC_RPL_LUSERUNKNOWN:         return "RPL_LUSERUNKNOWN";
+    case LIBIRC_RFC_RPL_LUSERCHANNELS:        return "RPL_LUSERCHANNELS";
+    case LIBIRC_RFC_RPL_LUSERME:              return "RPL_LUSERME";
+    case LIBIRC_RFC_RPL_ADMINME:              return "RPL_ADMINME";
+    case LIBIRC_RFC_RPL_ADMINLOC1:            return "RPL_ADMINLOC1";
+    case LIBIRC_RFC_RPL_ADMINLOC2:            return "RPL_ADMINLOC2";
+    case LIBIRC_RFC_RPL_ADMINEMAIL:           return "RPL_ADMINEMAIL";
+    case LIBIRC_RFC_RPL_TRACELOG:             return "RPL_TRACELOG";
+    case LIBIRC_RFC_RPL_TRACEEND:             return "RPL_TRACEEND";
+    case LIBIRC_RFC_RPL_TRYAGAIN:             return "RPL_TRYAGAIN";
+    case LIBIRC_RFC_RPL_AWAY:                 return "RPL_AWAY";
+    case LIBIRC_RFC_RPL_USERHOST:             return "RPL_USERHOST";
+    case LIBIRC_RFC_RPL_ISON:                 return "RPL_ISON";
+    case LIBIRC_RFC_RPL_UNAWAY:               return "RPL_UNAWAY";
+    case LIBIRC_RFC_RPL_NOWAWAY:              return "RPL_NOWAWAY";
+    case LIBIRC_RFC_RPL_WHOISUSER:            return "RPL_WHOISUSER";
+    case LIBIRC_RFC_RPL_WHOISSERVER:          return "RPL_WHOISSERVER";
+    case LIBIRC_RFC_RPL_WHOISOPERATOR:        return "RPL_WHOISOPERATOR";
+    case LIBIRC_RFC_RPL_WHOWASUSER:           return "RPL_WHOWASUSER";
+    case LIBIRC_RFC_RPL_ENDOFWHO:             return "RPL_ENDOFWHO";
+    case LIBIRC_RFC_RPL_WHOISIDLE:            return "RPL_WHOISIDLE";
+    case LIBIRC_RFC_RPL_ENDOFWHOIS:           return "RPL_ENDOFWHOIS";
+    case LIBIRC_RFC_RPL_WHOISCHANNELS:        return "RPL_WHOISCHANNELS";
+    case LIBIRC_RFC_RPL_LIST:                 return "RPL_LIST";
+    case LIBIRC_RFC_RPL_LISTEND:              return "RPL_LISTEND";
+    case LIBIRC_RFC_RPL_CHANNELMODEIS:        return "RPL_CHANNELMODEIS";
+    case LIBIRC_RFC_RPL_UNIQOPIS:             return "RPL_UNIQOPIS";
+    case LIBIRC_RFC_RPL_NOTOPIC:              return "RPL_NOTOPIC";
+    case LIBIRC_RFC_RPL_TOPIC:                return "RPL_TOPIC";
+    case LIBIRC_RFC_RPL_INVITING:             return "RPL_INVITING";
+    case LIBIRC_RFC_RPL_SUMMONING:            return "RPL_SUMMONING";
+    case LIBIRC_RFC_RPL_INVITELIST:           return "RPL_INVITELIST";
+    case LIBIRC_RFC_RPL_ENDOFINVITELIST:      return "RPL_ENDOFINVITELIST";
+    case LIBIRC_RFC_RPL_EXCEPTLIST:           return "RPL_EXCEPTLIST";
+    case LIBIRC_RFC_RPL_ENDOFEXCEPTLIST:      return "RPL_ENDOFEXCEPTLIST";
+    case LIBIRC_RFC_RPL_VERSION:              return "RPL_VERSION";
+    case LIBIRC_RFC_RPL_WHOREPLY:             return "RPL_WHOREPLY";
+    case LIBIRC_RFC_RPL_NAMREPLY:             return "RPL_NAMREPLY";
+    case LIBIRC_RFC_RPL_LINKS:                return "RPL_LINKS";
+    case LIBIRC_RFC_RPL_ENDOFLINKS:           return "RPL_ENDOFLINKS";
+    case LIBIRC_RFC_RPL_ENDOFNAMES:           return "RPL_ENDOFNAMES";
+    case LIBIRC_RFC_RPL_BANLIST:              return "RPL_BANLIST";
+    case LIBIRC_RFC_RPL_ENDOFBANLIST:         return "RPL_ENDOFBANLIST";
+    case LIBIRC_RFC_RPL_ENDOFWHOWAS:          return "RPL_ENDOFWHOWAS";
+    case LIBIRC_RFC_RPL_INFO:                 return "RPL_INFO";
+    case LIBIRC_RFC_RPL_MOTD:                 return "RPL_MOTD";
+    case LIBIRC_RFC_RPL_ENDOFINFO:            return "RPL_ENDOFINFO";
+    case LIBIRC_RFC_RPL_MOTDSTART:            return "RPL_MOTDSTART";
+    case LIBIRC_RFC_RPL_ENDOFMOTD:            return "RPL_ENDOFMOTD";
+    case LIBIRC_RFC_RPL_YOUREOPER:            return "RPL_YOUREOPER";
+    case LIBIRC_RFC_RPL_REHASHING:            return "RPL_REHASHING";
+    case LIBIRC_RFC_RPL_YOURESERVICE:         return "RPL_YOURESERVICE";
+    case LIBIRC_RFC_RPL_TIME:                 return "RPL_TIME";
+    case LIBIRC_RFC_RPL_USERSSTART:           return "RPL_USERSSTART";
+    case LIBIRC_RFC_RPL_USERS:                return "RPL_USERS";
+    case LIBIRC_RFC_RPL_ENDOFUSERS:           return "RPL_ENDOFUSERS";
+    case LIBIRC_RFC_RPL_NOUSERS:              return "RPL_NOUSERS";
+    case LIBIRC_RFC_ERR_NOSUCHNICK:           return "ERR_NOSUCHNICK";
+    case LIBIRC_RFC_ERR_NOSUCHSERVER:         return "ERR_NOSUCHSERVER";
+    case LIBIRC_RFC_ERR_NOSUCHCHANNEL:        return "ERR_NOSUCHCHANNEL";
+    case LIBIRC_RFC_ERR_CANNOTSENDTOCHAN:     return "ERR_CANNOTSENDTOCHAN";
+    case LIBIRC_RFC_ERR_TOOMANYCHANNELS:      return "ERR_TOOMANYCHANNELS";
+    case LIBIRC_RFC_ERR_WASNOSUCHNICK:        return "ERR_WASNOSUCHNICK";
+    case LIBIRC_RFC_ERR_TOOMANYTARGETS:       return "ERR_TOOMANYTARGETS";
+    case LIBIRC_RFC_ERR_NOSUCHSERVICE:        return "ERR_NOSUCHSERVICE";
+    case LIBIRC_RFC_ERR_NOORIGIN:             return "ERR_NOORIGIN";
+    case LIBIRC_RFC_ERR_NORECIPIENT:          return "ERR_NORECIPIENT";
+    case LIBIRC_RFC_ERR_NOTEXTTOSEND:         return "ERR_NOTEXTTOSEND";
+    case LIBIRC_RFC_ERR_NOTOPLEVEL:           return "ERR_NOTOPLEVEL";
+    case LIBIRC_RFC_ERR_WILDTOPLEVEL:         return "ERR_WILDTOPLEVEL";
+    case LIBIRC_RFC_ERR_BADMASK:              return "ERR_BADMASK";
+    case LIBIRC_RFC_ERR_UNKNOWNCOMMAND:       return "ERR_UNKNOWNCOMMAND";
+    case LIBIRC_RFC_ERR_NOMOTD:               return "ERR_NOMOTD";
+    case LIBIRC_RFC_ERR_NOADMININFO:          return "ERR_NOADMININFO";
+    case LIBIRC_RFC_ERR_FILEERROR:            return "ERR_FILEERROR";
+    case LIBIRC_RFC_ERR_NONICKNAMEGIVEN:      return "ERR_NONICKNAMEGIVEN";
+    case LIBIRC_RFC_ERR_ERRONEUSNICKNAME:     return "ERR_ERRONEUSNICKNAME";
+    case LIBIRC_RFC_ERR_NICKNAMEINUSE:        return "ERR_NICKNAMEINUSE";
+    case LIBIRC_RFC_ERR_NICKCOLLISION:        return "ERR_NICKCOLLISION";
+    case LIBIRC_RFC_ERR_UNAVAILRESOURCE:      return "ERR_UNAVAILRESOURCE";
+    case LIBIRC_RFC_ERR_USERNOTINCHANNEL:     return "ERR_USERNOTINCHANNEL";
+    case LIBIRC_RFC_ERR_NOTONCHANNEL:         return "ERR_NOTONCHANNEL";
+    case LIBIRC_RFC_ERR_USERONCHANNEL:        return "ERR_USERONCHANNEL";
+    case LIBIRC_RFC_ERR_NOLOGIN:              return "ERR_NOLOGIN";
+    case LIBIRC_RFC_ERR_SUMMONDISABLED:       return "ERR_SUMMONDISABLED";
+    case LIBIRC_RFC_ERR_USERSDISABLED:        return "ERR_USERSDISABLED";
+    case LIBIRC_RFC_ERR_NOTREGISTERED:        return "ERR_NOTREGISTERED";
+    case LIBIRC_RFC_ERR_NEEDMOREPARAMS:       return "ERR_NEEDMOREPARAMS";
+    case LIBIRC_RFC_ERR_ALREADYREGISTRED:     return "ERR_ALREADYREGISTRED";
+    case LIBIRC_RFC_ERR_NOPERMFORHOST:        return "ERR_NOPERMFORHOST";
+    case LIBIRC_RFC_ERR_PASSWDMISMATCH:       return "ERR_PASSWDMISMATCH";
+    case LIBIRC_RFC_ERR_YOUREBANNEDCREEP:     return "ERR_YOUREBANNEDCREEP";
+    case LIBIRC_RFC_ERR_YOUWILLBEBANNED:      return "ERR_YOUWILLBEBANNED";
+    case LIBIRC_RFC_ERR_KEYSET:               return "ERR_KEYSET";
+    case LIBIRC_RFC_ERR_CHANNELISFULL:        return "ERR_CHANNELISFULL";
+    case LIBIRC_RFC_ERR_UNKNOWNMODE:          return "ERR_UNKNOWNMODE";
+    case LIBIRC_RFC_ERR_INVITEONLYCHAN:       return "ERR_INVITEONLYCHAN";
+    case LIBIRC_RFC_ERR_BANNEDFROMCHAN:       return "ERR_BANNEDFROMCHAN";
+    case LIBIRC_RFC_ERR_BADCHANNELKEY:        return "ERR_BADCHANNELKEY";
+    case LIBIRC_RFC_ERR_BADCHANMASK:          return "ERR_BADCHANMASK";
+    case LIBIRC_RFC_ERR_NOCHANMODES:          return "ERR_NOCHANMODES";
+    case LIBIRC_RFC_ERR_BANLISTFULL:          return "ERR_BANLISTFULL";
+    case LIBIRC_RFC_ERR_NOPRIVILEGES:         return "ERR_NOPRIVILEGES";
+    case LIBIRC_RFC_ERR_CHANOPRIVSNEEDED:     return "ERR_CHANOPRIVSNEEDED";
+    case LIBIRC_RFC_ERR_CANTKILLSERVER:       return "ERR_CANTKILLSERVER";
+    case LIBIRC_RFC_ERR_RESTRICTED:           return "ERR_RESTRICTED";
+    case LIBIRC_RFC_ERR_UNIQOPPRIVSNEEDED:    return "ERR_UNIQOPPRIVSNEEDED";
+    case LIBIRC_RFC_ERR_NOOPERHOST:           return "ERR_NOOPERHOST";
+    case LIBIRC_RFC_ERR_UMODEUNKNOWNFLAG:     return "ERR_UMODEUNKNOWNFLAG";
+    case LIBIRC_RFC_ERR_USERSDONTMATCH:       return "ERR_USERSDONTMATCH";
+    default:                                  return NULL;
+    }
+}
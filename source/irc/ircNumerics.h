@@ -0,0 +1,14 @@
+#ifndef _IRC_NUMERICS_H_
+#define _IRC_NUMERICS_H_
+
+//ircNumerics.h
+//Author: Simon Wittenberg
+
+// numerics are three digits, so every handler table has this many entries
+#define IRC_NUMERIC_COUNT 1000
+
+// returns the name of a numeric reply as in libirc_rfcnumeric.h without the LIBIRC_RFC_
+// prefix, e.g. "RPL_WELCOME" for 1, or NULL if it is not listed there
+const char* irc_numeric_name(unsigned int numeric);
+
+#endif //_IRC_NUMERICS_H_
@@ -0,0 +1,296 @@
+#include "ircParser.h"
+#include <util/util.h>
+
+//ircParser.cpp
+//Author: Simon Wittenberg
+
+#if defined (__SSE2__) || defined (_M_X64) || (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define IRC_PARSER_SSE2
+    #include <emmintrin.h>
+#endif
+#if defined (__AVX2__)
+    #include <immintrin.h>
+#endif
+#if defined (_MSC_VER)
+    #include <intrin.h>
+#endif
+
+
+// index of the lowest set bit, mask must not be 0
+static inline unsigned int irc_parser_first_bit(unsigned int mask)
+{
+#if defined (_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+
+const char* IrcParser::findChar(const char* begin, const char* end, char c)
+{
+    const char* p = begin;
+#if defined (__AVX2__)
+    const __m256i needle32 = _mm256_set1_epi8(c);
+    while(end - p >= 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)p);
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle32));
+        if(mask)
+            return p + irc_parser_first_bit(mask);
+        p += 32;
+    }
+#endif
+#if defined (IRC_PARSER_SSE2)
+    const __m128i needle16 = _mm_set1_epi8(c);
+    while(end - p >= 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)p);
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle16));
+        if(mask)
+            return p + irc_parser_first_bit(mask);
+        p += 16;
+    }
+#endif
+    while(p < end && *p != c)
+        p++;
+    return p;
+}
+
+// Perfect hash over the names of IrcCommand: no two of them share a slot, so a lookup
+// is one hash, one table access and one compare. The constants were found by trying
+// multipliers until there were no collisions, rerun that when adding a command.
+#define IRC_COMMAND_TABLE_SIZE 64
+#define IRC_COMMAND_MIN_LENGTH 3
+#define IRC_COMMAND_MAX_LENGTH 12
+
+struct IrcCommandEntry
+{
+    const char*     name;
+    IrcCommand      command;
+};
+
+static const IrcCommandEntry irc_command_table[IRC_COMMAND_TABLE_SIZE] =
+{
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 0
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 1
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 2
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 3
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 4
+    { "AWAY",         IRC_COMMAND_AWAY },                 // 5
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 6
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 7
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 8
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 9
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 10
+    { "JOIN",         IRC_COMMAND_JOIN },                 // 11
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 12
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 13
+    { "ERROR",        IRC_COMMAND_ERROR },                // 14
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 15
+    { "BATCH",        IRC_COMMAND_BATCH },                // 16
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 17
+    { "TAGMSG",       IRC_COMMAND_TAGMSG },               // 18
+    { "KICK",         IRC_COMMAND_KICK },                 // 19
+    { "PING",         IRC_COMMAND_PING },                 // 20
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 21
+    { "NICK",         IRC_COMMAND_NICK },                 // 22
+    { "CAP",          IRC_COMMAND_CAP },                  // 23
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 24
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 25
+    { "PONG",         IRC_COMMAND_PONG },                 // 26
+    { "TOPIC",        IRC_COMMAND_TOPIC },                // 27
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 28
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 29
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 30
+    { "ACCOUNT",      IRC_COMMAND_ACCOUNT },              // 31
+    { "PRIVMSG",      IRC_COMMAND_PRIVMSG },              // 32
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 33
+    { "WALLOPS",      IRC_COMMAND_WALLOPS },              // 34
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 35
+    { "KILL",         IRC_COMMAND_KILL },                 // 36
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 37
+    { "CHGHOST",      IRC_COMMAND_CHGHOST },              // 38
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 39
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 40
+    { "PART",         IRC_COMMAND_PART },                 // 41
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 42
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 43
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 44
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 45
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 46
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 47
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 48
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 49
+    { "INVITE",       IRC_COMMAND_INVITE },               // 50
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 51
+    { "SETNAME",      IRC_COMMAND_SETNAME },              // 52
+    { "MODE",         IRC_COMMAND_MODE },                 // 53
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 54
+    { "AUTHENTICATE", IRC_COMMAND_AUTHENTICATE },         // 55
+    { "NOTICE",       IRC_COMMAND_NOTICE },               // 56
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 57
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 58
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 59
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 60
+    { NULL,           IRC_COMMAND_UNKNOWN },              // 61
+    { "QUIT",         IRC_COMMAND_QUIT },                 // 62
+    { NULL,           IRC_COMMAND_UNKNOWN }               // 63
+};
+
+static inline unsigned int irc_command_hash(const char* command, size_t length)
+{
+    return (unsigned int)(length
+        + (unsigned char)command[0]
+        + (unsigned char)command[1]
+        + 17 * (unsigned char)command[length - 1]) & (IRC_COMMAND_TABLE_SIZE - 1);
+}
+
+IrcCommand IrcParser::lookupCommand(const IrcStringView& command)
+{
+    if(command.size < IRC_COMMAND_MIN_LENGTH || command.size > IRC_COMMAND_MAX_LENGTH)
+        return IRC_COMMAND_UNKNOWN;
+    const IrcCommandEntry& entry = irc_command_table[irc_command_hash(command.data, command.size)];
+    if(entry.name && command.equals(entry.name))
+        return entry.command;
+    return IRC_COMMAND_UNKNOWN;
+}
+
+
+const char* IrcParser::findLineEnd(const char* begin, const char* end)
+{
+    // servers terminate with "\r\n" but some only send '\n', so that is what we look for
+    // and the '\r' is dropped by parseLine(...)
+    return findChar(begin, end, '\n');
+}
+
+static inline const char* irc_parser_skip_spaces(const char* p, const char* end)
+{
+    while(p < end && *p == ' ')
+        p++;
+    return p;
+}
+
+int IrcParser::parseLine(const char* begin, const char* end, IrcParsedLine* line)
+{
+    const char* p = begin;
+    const char* token;
+    if(end > p && end[-1] == '\r')
+        end--;
+
+    line->tags = IrcStringView();
+    line->prefix = IrcStringView();
+    line->count = 0;
+    line->numeric = 0;
+
+    // @tags
+    if(p < end && *p == '@')
+    {
+        token = findChar(p, end, ' ');
+        line->tags = IrcStringView(p + 1, token - p - 1);
+        p = irc_parser_skip_spaces(token, end);
+    }
+
+    // :prefix
+    if(p < end && *p == ':')
+    {
+        token = findChar(p, end, ' ');
+        line->prefix = IrcStringView(p + 1, token - p - 1);
+        p = irc_parser_skip_spaces(token, end);
+    }
+
+    // command
+    token = findChar(p, end, ' ');
+    line->command = IrcStringView(p, token - p);
+    Return_MinusOne_Unless(line->command.size);
+    if(line->command.size == 3
+        && p[0] >= '0' && p[0] <= '9'
+        && p[1] >= '0' && p[1] <= '9'
+        && p[2] >= '0' && p[2] <= '9')
+    {
+        line->numeric = (p[0] - '0') * 100 + (p[1] - '0') * 10 + (p[2] - '0');
+        line->commandId = IRC_COMMAND_NUMERIC;
+    }
+    else
+        line->commandId = lookupCommand(line->command);
+    p = token;
+
+    // params
+    while(line->count < IRC_MAX_PARAMS)
+    {
+        p = irc_parser_skip_spaces(p, end);
+        if(p == end)
+            break;
+
+        if(*p == ':' || line->count == IRC_MAX_PARAMS - 1)
+        {
+            if(*p == ':')
+                p++;
+            line->params[line->count++] = IrcStringView(p, end - p);
+            break;
+        }
+
+        token = findChar(p, end, ' ');
+        line->params[line->count++] = IrcStringView(p, token - p);
+        p = token;
+    }
+    return 0;
+}
+
+bool IrcParser::nextTag(IrcStringView* tags, IrcStringView* key, IrcStringView* value)
+{
+    Return_False_Unless(tags->size);
+    const char* begin = tags->data;
+    const char* end = tags->data + tags->size;
+    const char* tagEnd = findChar(begin, end, ';');
+    const char* equals = findChar(begin, tagEnd, '=');
+
+    *key = IrcStringView(begin, equals - begin);
+    *value = equals < tagEnd ? IrcStringView(equals + 1, tagEnd - equals - 1) : IrcStringView();
+
+    if(tagEnd < end)
+        tagEnd++;
+    *tags = IrcStringView(tagEnd, end - tagEnd);
+    return true;
+}
+
+bool IrcParser::findTag(const IrcStringView& tags, const char* key, IrcStringView* value)
+{
+    IrcStringView rest = tags;
+    IrcStringView tagKey;
+    while(nextTag(&rest, &tagKey, value))
+    {
+        if(tagKey.equals(key))
+            return true;
+    }
+    return false;
+}
+
+size_t IrcParser::unescapeTagValue(const IrcStringView& value, char* out, size_t size)
+{
+    Return_Zero_Unless(size);
+    size_t written = 0;
+    for(size_t i = 0; i < value.size && written < size - 1; i++)
+    {
+        char c = value.data[i];
+        if(c == '\\')
+        {
+            // a lone backslash at the end is dropped
+            if(++i == value.size)
+                break;
+            switch(value.data[i])
+            {
+            case ':':   c = ';';    break;
+            case 's':   c = ' ';    break;
+            case 'r':   c = '\r';   break;
+            case 'n':   c = '\n';   break;
+            default:    c = value.data[i];  break;
+            }
+        }
+        out[written++] = c;
+    }
+    out[written] = 0;
+    return written;
+}
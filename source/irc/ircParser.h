@@ -0,0 +1,63 @@
+#ifndef _IRC_PARSER_H_
+#define _IRC_PARSER_H_
+#include <irc/ircMessage.h>
+
+//ircParser.h
+//Author: Simon Wittenberg
+
+// Parser for raw irc lines (RFC 1459/2812 plus IRCv3 message tags). It works in place,
+// nothing is copied or written, all results are views into the parsed buffer.
+// Line ends and separators are searched 16 bytes at a time with SSE2 (32 with AVX2
+// if the compiler targets it), see ircParser.cpp.
+
+// the longest line we accept: 8191 bytes of tags plus 512 bytes of message, as of IRCv3
+#define IRC_MAX_LINE_LENGTH 8703
+
+struct IrcParsedLine
+{
+    IrcStringView   tags;       // without the leading '@', see IrcParser::nextTag(...)
+    IrcStringView   prefix;     // without the leading ':', empty if the server sent none
+    IrcStringView   command;
+    IrcCommand      commandId;  // IRC_COMMAND_NUMERIC for numerics
+    IrcStringView   params[IRC_MAX_PARAMS];
+    unsigned int    count;
+    unsigned int    numeric;    // the numeric or 0 if command is a word
+};
+
+class IrcParser
+{
+public:
+    // returns a pointer to the first '\n' in [begin, end) or end if there is none
+    static const char* findLineEnd(const char* begin, const char* end);
+
+    // returns a pointer to the first c in [begin, end) or end if there is none
+    static const char* findChar(const char* begin, const char* end, char c);
+
+    // int IrcParser :: parseLine(...)
+    //
+    // parses one line, a trailing '\r' is ignored. A 15th param takes the rest of the
+    // line, like a trailing one (RFC 2812).
+    // params:
+    // const char* begin        - the first char of the line
+    // const char* end          - the '\n' ending the line (or one past its last char)
+    // IrcParsedLine* line(out) - the parsed line, it points into [begin, end)
+    // return:          0 on success, -1 if the line has no command
+    static int parseLine(const char* begin, const char* end, IrcParsedLine* line);
+
+    // maps a command to its IrcCommand with a perfect hash, a single table lookup and
+    // compare. Returns IRC_COMMAND_UNKNOWN for anything not in IrcCommand (and for numerics).
+    static IrcCommand lookupCommand(const IrcStringView& command);
+
+    // takes the next "key[=value]" off the front of tags, the value is still escaped.
+    // returns false when there are no tags left
+    static bool nextTag(IrcStringView* tags, IrcStringView* key, IrcStringView* value);
+
+    // looks up a tag by its key, returns false if the line does not carry it
+    static bool findTag(const IrcStringView& tags, const char* key, IrcStringView* value);
+
+    // unescapes a tag value ("\:" -> ';', "\s" -> ' ', ...) into out, writes at most
+    // size - 1 chars and a terminating 0, returns the number of chars written
+    static size_t unescapeTagValue(const IrcStringView& value, char* out, size_t size);
+};
+
+#endif //_IRC_PARSER_H_
@@ -0,0 +1,48 @@
+#include "ircPayload.h"
+#include <stdlib.h>
+#include <string.h>
+
+//ircPayload.cpp
+//Author: Simon Wittenberg
+
+
+IrcPayload::IrcPayload(const char* data, size_t size)
+{
+    _assign(data, size);
+}
+
+IrcPayload::IrcPayload(const std::string& text)
+{
+    _assign(text.data(), text.size());
+}
+
+IrcPayload::IrcPayload(const IrcPayload& other)
+{
+    _block = other._block;
+    if(_block)
+        ATOMIC_INCREMENT(_block->references);
+}
+
+IrcPayload::~IrcPayload()
+{
+    if(_block && ATOMIC_DECREMENT(_block->references) == 0)
+        free(_block);
+}
+
+IrcPayload& IrcPayload::operator=(const IrcPayload& other)
+{
+    IrcPayload copy(other);
+    swap(copy);
+    return *this;
+}
+
+void IrcPayload::_assign(const char* data, size_t size)
+{
+    // one allocation for the count and the text
+    _block = (Block*) malloc(sizeof(Block) + size);
+    if(!_block)
+        return;
+    _block->references = 1;
+    _block->size = size;
+    memcpy(_block + 1, data, size);
+}
@@ -0,0 +1,73 @@
+#ifndef _IRC_PAYLOAD_H_
+#define _IRC_PAYLOAD_H_
+#include <string>
+#include <algorithm>
+#include <util/threadHelper.h>
+#include <irc/ircMessage.h>
+
+//ircPayload.h
+//Author: Simon Wittenberg
+
+// Text that goes out to many targets, possibly on several connections. It is copied once
+// into an immutable, reference counted buffer. The queued lines only refer to the part of
+// it they carry and build nothing but their "PRIVMSG <target> :" themselves, so a broadcast
+// costs memory and time per payload, not per destination.
+// Copies share the buffer, they may be handed to connections on other threads.
+
+class IrcPayload
+{
+public:
+    IrcPayload() : _block(NULL) {};
+    IrcPayload(const char* data, size_t size);
+    explicit IrcPayload(const std::string& text);
+    IrcPayload(const IrcPayload& other);
+    ~IrcPayload();
+
+    IrcPayload& operator=(const IrcPayload& other);
+    void swap(IrcPayload& other) { Block* block = _block; _block = other._block; other._block = block; };
+
+    const char* data() const { return _block ? (const char*)(_block + 1) : ""; };
+    size_t size() const { return _block ? _block->size : 0; };
+    bool empty() const { return size() == 0; };
+    IrcStringView view() const { return IrcStringView(data(), size()); };
+
+private:
+    // followed by the text
+    struct Block
+    {
+        irc_atomic_t    references;
+        size_t          size;
+    };
+
+    void _assign(const char* data, size_t size);
+
+    Block*  _block;
+};
+
+// A line waiting to be sent: head, then the part of payload, then tail. Lines without
+// a payload are all head.
+struct IrcOutboundLine
+{
+    IrcOutboundLine() : offset(0), size(0) {};
+
+    std::string         head;       // e.g. "PRIVMSG #chan :"
+    IrcPayload          payload;
+    size_t              offset;     // the part of payload carried by this line
+    size_t              size;
+    IrcStringView       tail;       // static text only, e.g. the "\x01" closing a ctcp
+
+    IrcStringView body() const { return IrcStringView(payload.data() + offset, size); };
+    // without the line end
+    size_t length() const { return head.size() + size + tail.size; };
+
+    void swap(IrcOutboundLine& other)
+    {
+        head.swap(other.head);
+        payload.swap(other.payload);
+        std::swap(offset, other.offset);
+        std::swap(size, other.size);
+        std::swap(tail, other.tail);
+    };
+};
+
+#endif //_IRC_PAYLOAD_H_
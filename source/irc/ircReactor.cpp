@@ -0,0 +1,602 @@
+#include "ircReactor.h"
+#include "ircConnection.h"
+#include <util/fdSet.h>
+#include <assert.h>
+
+#if defined (__linux__)
+    #include <sys/epoll.h>
+#endif
+
+//ircReactor.cpp
+//Author: Simon Wittenberg
+
+
+// interval in which every connection gets ticked (reconnects) and re-armed,
+// same as the select timeout irc_run uses
+#define IRC_REACTOR_HOUSEKEEPING_MS 250
+#define IRC_REACTOR_MAX_EVENTS      64
+
+
+THREAD_FUNCTION(irc_reactor_loop_thread)
+{
+    IrcReactorLoop* loop = (IrcReactorLoop*) arg;
+    loop->run();
+    return 0;
+}
+
+
+IrcReactor::IrcReactor(unsigned int loopCount/* = 0*/)
+{
+    INIT_MUTEX(_mutex);
+    _running = false;
+
+    if(loopCount == 0)
+        loopCount = getProcessorCount();
+
+    for(unsigned int i = 0; i < loopCount; i++)
+        _loops.push_back(new IrcReactorLoop());
+}
+
+IrcReactor::~IrcReactor()
+{
+    stop();
+    for(unsigned int i = 0; i < _loops.size(); i++)
+        delete _loops[i];
+    _loops.clear();
+    DESTROY_MUTEX(_mutex);
+}
+
+int IrcReactor::start()
+{
+    MutexHandle handle(&_mutex);
+    if(_running)
+        return 1;
+
+    for(unsigned int i = 0; i < _loops.size(); i++)
+    {
+        if(_loops[i]->start())
+        {
+            printf("Could not start reactor loop #%d\n", i);
+            for(unsigned int j = 0; j < i; j++)
+                _loops[j]->stop();
+            return -1;
+        }
+    }
+    _running = true;
+    return 0;
+}
+
+void IrcReactor::stop()
+{
+    MutexHandle handle(&_mutex);
+    Return_Void_Unless(_running);
+    for(unsigned int i = 0; i < _loops.size(); i++)
+        _loops[i]->stop();
+    _running = false;
+}
+
+IrcReactorLoop* IrcReactor::add(IrcConnection* connection)
+{
+    MutexHandle handle(&_mutex);
+    Return_NULL_Unless(connection && _loops.size() > 0);
+
+    IrcReactorLoop* loop = _loops[0];
+    unsigned int fewest = loop->getConnectionCount();
+    for(unsigned int i = 1; i < _loops.size(); i++)
+    {
+        unsigned int count = _loops[i]->getConnectionCount();
+        if(count < fewest)
+        {
+            loop = _loops[i];
+            fewest = count;
+        }
+    }
+    loop->add(connection);
+    return loop;
+}
+
+void IrcReactor::remove(IrcConnection* connection)
+{
+    Return_Void_Unless(connection);
+    IrcReactorLoop* loop = connection->getReactorLoop();
+    if(loop)
+        loop->remove(connection);
+}
+
+unsigned int IrcReactor::getConnectionCount()
+{
+    unsigned int count = 0;
+    for(unsigned int i = 0; i < _loops.size(); i++)
+        count += _loops[i]->getConnectionCount();
+    return count;
+}
+
+
+IrcReactorLoop::IrcReactorLoop()
+{
+    INIT_MUTEX(_mutex);
+    _connectionCount = 0;
+    _nextHousekeeping = 0;
+    _running = false;
+    _threadKnown = false;
+    _processing = NULL;
+    _wakePending = false;
+#if defined (__linux__)
+    _nextTimer = 0;
+    _epollFd = epoll_create(IRC_REACTOR_MAX_EVENTS);
+    size_t capacity = irc_fd_capacity();
+    _inSet = irc_fd_alloc(capacity);
+    _outSet = irc_fd_alloc(capacity);
+
+    // the wakeup channel is the only entry without a connection
+    if(_epollFd >= 0 && _wakeup.isValid())
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = NULL;
+        epoll_ctl(_epollFd, EPOLL_CTL_ADD, _wakeup.getDescriptor(), &event);
+    }
+#endif
+}
+
+IrcReactorLoop::~IrcReactorLoop()
+{
+    stop();
+#if defined (__linux__)
+    if(_epollFd >= 0)
+        close(_epollFd);
+    irc_fd_free(_inSet);
+    irc_fd_free(_outSet);
+#endif
+    DESTROY_MUTEX(_mutex);
+}
+
+int IrcReactorLoop::start()
+{
+    MutexHandle handle(&_mutex);
+    if(_running)
+        return 1;
+    Return_MinusOne_Unless(_wakeup.isValid());
+#if defined (__linux__)
+    Return_MinusOne_Unless(_epollFd >= 0 && _inSet && _outSet);
+#endif
+    _running = true;
+    if(START_THREAD(_thread, irc_reactor_loop_thread, this))
+    {
+        _running = false;
+        return -1;
+    }
+    return 0;
+}
+
+void IrcReactorLoop::stop()
+{
+    MutexHandle handle(&_mutex);
+    Return_Void_Unless(_running);
+    _running = false;
+    _wakeup.signal();
+    handle.release();
+
+    JOIN_THREAD(_thread);
+
+    // the connections stay connected, but nobody drives them anymore
+    _adoptPending();
+    while(_entries.size() > 0)
+        _drop(_entries.size() - 1);
+}
+
+void IrcReactorLoop::add(IrcConnection* connection)
+{
+    MutexHandle handle(&_mutex);
+    _pendingAdds.push_back(connection);
+    _connectionCount++;
+    _wakeup.signal();
+}
+
+void IrcReactorLoop::remove(IrcConnection* connection)
+{
+    MutexHandle handle(&_mutex);
+    _pendingRemoves.push_back(connection);
+    _wakeup.signal();
+}
+
+void IrcReactorLoop::detach(IrcConnection* connection)
+{
+    // same order as a connection waking us up from _queueLine(...)
+    MutexHandle innerHandle(&connection->_innerMutex);
+    MutexHandle handle(&_mutex);
+    // the loop would wait for itself
+    assert(!(_threadKnown && SAME_THREAD(_threadId, CURRENT_THREAD_ID())));
+
+    for(unsigned int i = _woken.size(); i > 0; i--)
+    {
+        if(_woken[i-1] == connection)
+            _woken.erase(_woken.begin() + (i-1));
+    }
+    // _drop(...) let go of it already, e.g. because it quit
+    Return_Void_Unless(connection->_reactorLoop == this);
+
+    // not adopted yet, the loop never saw it
+    for(unsigned int i = 0; i < _pendingAdds.size(); i++)
+    {
+        if(_pendingAdds[i] == connection)
+        {
+            _pendingAdds.erase(_pendingAdds.begin() + i);
+            _connectionCount--;
+            connection->_reactorLoop = NULL;
+            return;
+        }
+    }
+
+    EventHandle dropped;
+    Detach waiter = { connection, &dropped };
+    _detaching.push_back(waiter);
+    _pendingRemoves.push_back(connection);
+    _wakeup.signal();
+    handle.release();
+    innerHandle.release();
+
+    // set by _drop(...), stop() drops all connections as well
+    dropped.wait();
+}
+
+void IrcReactorLoop::wake(IrcConnection* connection)
+{
+    MutexHandle handle(&_mutex);
+    // whatever a callback sends is picked up when the loop re-arms the connection after processing it
+    Return_Void_Unless(connection != _processing);
+    _woken.push_back(connection);
+
+    // one signal is enough until the loop took the woken connections
+    Unless(_wakePending)
+    {
+        _wakePending = true;
+        _wakeup.signal();
+    }
+}
+
+void IrcReactorLoop::_takeWoken()
+{
+    std::vector<IrcConnection*> woken;
+    MutexHandle handle(&_mutex);
+    woken.swap(_woken);
+    _wakePending = false;
+    handle.release();
+
+    _wakeup.drain();
+
+#if defined (__linux__)
+    for(unsigned int i = 0; i < woken.size(); i++)
+    {
+        std::map<IrcConnection*, Entry*>::iterator found = _index.find(woken[i]);
+        if(found != _index.end())
+            _active.push_back(found->second);
+    }
+#endif
+}
+
+void IrcReactorLoop::run()
+{
+    MutexHandle threadHandle(&_mutex);
+    _threadId = CURRENT_THREAD_ID();
+    _threadKnown = true;
+    threadHandle.release();
+
+    while(true)
+    {
+        MutexHandle handle(&_mutex);
+        bool running = _running;
+        handle.release();
+        Unless(running)
+            break;
+
+        _runOnce(getMilliseconds());
+    }
+}
+
+void IrcReactorLoop::_adoptPending()
+{
+    std::vector<IrcConnection*> adds, removes;
+    MutexHandle handle(&_mutex);
+    adds.swap(_pendingAdds);
+    removes.swap(_pendingRemoves);
+    handle.release();
+
+    for(unsigned int i = 0; i < adds.size(); i++)
+    {
+        Entry* entry = new Entry();
+        entry->connection = adds[i];
+        entry->fd = -1;
+        entry->events = 0;
+        entry->generation = 0;
+        entry->timed = false;
+        _entries.push_back(entry);
+        _index[entry->connection] = entry;
+        // connect right away instead of waiting for the next housekeeping
+        adds[i]->tick(getMilliseconds());
+#if defined (__linux__)
+        _active.push_back(entry);
+#endif
+    }
+
+    for(unsigned int i = 0; i < removes.size(); i++)
+    {
+        for(unsigned int j = 0; j < _entries.size(); j++)
+        {
+            if(_entries[j]->connection == removes[i])
+            {
+                _drop(j);
+                break;
+            }
+        }
+    }
+}
+
+void IrcReactorLoop::_drop(unsigned int index)
+{
+    Entry* entry = _entries[index];
+    _entries[index] = _entries.back();
+    _entries.pop_back();
+    _index.erase(entry->connection);
+
+#if defined (__linux__)
+    if(entry->fd >= 0)
+        epoll_ctl(_epollFd, EPOLL_CTL_DEL, entry->fd, NULL);
+    for(unsigned int i = _active.size(); i > 0; i--)
+    {
+        if(_active[i-1] == entry)
+        {
+            _active[i-1] = _active.back();
+            _active.pop_back();
+        }
+    }
+    for(unsigned int i = _timers.size(); i > 0; i--)
+    {
+        if(_timers[i-1] == entry)
+        {
+            _timers[i-1] = _timers.back();
+            _timers.pop_back();
+        }
+    }
+#endif
+
+    std::vector<EventHandle*> dropped;
+    MutexHandle innerHandle(&entry->connection->_innerMutex);
+    MutexHandle handle(&_mutex);
+    if(entry->connection->_reactorLoop == this)
+        entry->connection->_reactorLoop = NULL;
+    for(unsigned int i = _detaching.size(); i > 0; i--)
+    {
+        if(_detaching[i-1].connection == entry->connection)
+        {
+            dropped.push_back(_detaching[i-1].dropped);
+            _detaching.erase(_detaching.begin() + (i-1));
+        }
+    }
+    _connectionCount--;
+    handle.release();
+    innerHandle.release();
+    delete entry;
+
+    // whoever waits in detach(...) may delete the connection right away
+    for(unsigned int i = 0; i < dropped.size(); i++)
+        dropped[i]->set();
+}
+
+void IrcReactorLoop::_housekeeping(millis_t now)
+{
+    for(unsigned int i = _entries.size(); i > 0; i--)
+    {
+        IrcConnection* connection = _entries[i-1]->connection;
+        connection->tick(now);
+
+        // connections that quit and don't want to reconnect leave the reactor
+        if(!connection->isRunning() && !connection->doesReconnect())
+        {
+            _drop(i-1);
+            continue;
+        }
+#if defined (__linux__)
+        _active.push_back(_entries[i-1]);
+#endif
+    }
+}
+
+#if defined (__linux__)
+
+void IrcReactorLoop::_runOnce(millis_t now)
+{
+    _adoptPending();
+
+    if(now >= _nextHousekeeping)
+    {
+        _housekeeping(now);
+        _nextHousekeeping = now + IRC_REACTOR_HOUSEKEEPING_MS;
+    }
+
+    // only connections that did something since the last round can have changed interest
+    for(unsigned int i = 0; i < _active.size(); i++)
+        _arm(_active[i]);
+    _active.clear();
+
+    struct epoll_event events[IRC_REACTOR_MAX_EVENTS];
+    millis_t wakeAt = _nextHousekeeping;
+    if(_nextTimer && _nextTimer < wakeAt)
+        wakeAt = _nextTimer;
+    int timeout = wakeAt > now ? (int)(wakeAt - now) : 0;
+    int count = epoll_wait(_epollFd, events, IRC_REACTOR_MAX_EVENTS, timeout);
+
+    for(int i = 0; i < count; i++)
+    {
+        Entry* entry = (Entry*) events[i].data.ptr;
+        if(!entry)
+        {
+            _takeWoken();
+            continue;
+        }
+        unsigned int ready = events[i].events;
+        _process(entry, (ready & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0, (ready & (EPOLLOUT | EPOLLERR | EPOLLHUP)) != 0);
+        _active.push_back(entry);
+    }
+
+    if(_nextTimer)
+        _fireTimers(getMilliseconds());
+}
+
+void IrcReactorLoop::_fireTimers(millis_t now)
+{
+    Return_Void_Unless(now >= _nextTimer);
+    // re-arming flushes what the flood control released by now,
+    // connections that still hold lines back come back with a new deadline
+    for(unsigned int i = 0; i < _timers.size(); i++)
+    {
+        _timers[i]->timed = false;
+        _active.push_back(_timers[i]);
+    }
+    _timers.clear();
+    _nextTimer = 0;
+}
+
+void IrcReactorLoop::_arm(Entry* entry)
+{
+    IrcConnection* connection = entry->connection;
+    unsigned int generation = connection->getSessionGeneration();
+    int maxfd = -1;
+    int fd = -1;
+    unsigned int events = 0;
+
+    // irc_add_select_descriptors tells us the interest through the sets. They hold the DCC
+    // sockets of the session as well, so the socket to watch comes from the connection
+    if(connection->addDescriptors(_inSet, _outSet, &maxfd) == 0 && maxfd >= 0)
+    {
+        fd = connection->getSocket();
+        if(fd >= 0 && irc_fd_isset(_inSet, fd))
+            events |= EPOLLIN;
+        if(fd >= 0 && irc_fd_isset(_outSet, fd))
+            events |= EPOLLOUT;
+        irc_fd_clear_upto(_inSet, maxfd);
+        irc_fd_clear_upto(_outSet, maxfd);
+
+        millis_t deadline = connection->getOutboundDeadline();
+        if(deadline && !entry->timed)
+        {
+            entry->timed = true;
+            _timers.push_back(entry);
+        }
+        if(deadline && (!_nextTimer || deadline < _nextTimer))
+            _nextTimer = deadline;
+    }
+
+    if(fd < 0)
+    {
+        if(entry->fd >= 0)
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, entry->fd, NULL);
+        entry->fd = -1;
+        entry->events = 0;
+        return;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = entry;
+
+    // a new session may well have gotten the same descriptor number as the old one
+    if(fd != entry->fd || generation != entry->generation)
+    {
+        if(entry->fd >= 0)
+            epoll_ctl(_epollFd, EPOLL_CTL_DEL, entry->fd, NULL);
+        if(epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) < 0 && errno == EEXIST)
+            epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &event);
+    }
+    else if(events != entry->events)
+    {
+        if(epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &event) < 0 && errno == ENOENT)
+            epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    entry->fd = fd;
+    entry->events = events;
+    entry->generation = generation;
+}
+
+void IrcReactorLoop::_process(Entry* entry, bool readable, bool writable)
+{
+    Return_Void_Unless(entry->fd >= 0);
+    if(readable)
+        irc_fd_set(_inSet, entry->fd);
+    if(writable)
+        irc_fd_set(_outSet, entry->fd);
+
+    MutexHandle handle(&_mutex);
+    _processing = entry->connection;
+    handle.release();
+
+    entry->connection->processDescriptors(_inSet, _outSet);
+
+    handle.aquire(&_mutex);
+    _processing = NULL;
+    handle.release();
+
+    irc_fd_clear(_inSet, entry->fd);
+    irc_fd_clear(_outSet, entry->fd);
+}
+
+#else // select fallback
+
+void IrcReactorLoop::_runOnce(millis_t now)
+{
+    _adoptPending();
+
+    if(now >= _nextHousekeeping)
+    {
+        _housekeeping(now);
+        _nextHousekeeping = now + IRC_REACTOR_HOUSEKEEPING_MS;
+    }
+
+    fd_set in_set, out_set;
+    int maxfd = 0;
+    FD_ZERO (&in_set);
+    FD_ZERO (&out_set);
+
+    // wake up in time for the next line a flood control holds back
+    millis_t wakeAt = _nextHousekeeping;
+    for(unsigned int i = 0; i < _entries.size(); i++)
+    {
+        IrcConnection* connection = _entries[i]->connection;
+        connection->addDescriptors(&in_set, &out_set, &maxfd);
+        millis_t deadline = connection->getOutboundDeadline();
+        if(deadline && deadline < wakeAt)
+            wakeAt = deadline;
+    }
+
+    int wakefd = _wakeup.getDescriptor();
+    FD_SET (wakefd, &in_set);
+    if(wakefd > maxfd)
+        maxfd = wakefd;
+
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = (long)(wakeAt > now ? wakeAt - now : 0) * 1000;
+
+    if ( select (maxfd + 1, &in_set, &out_set, 0, &tv) < 0 )
+        return;
+
+    if(FD_ISSET (wakefd, &in_set))
+        _takeWoken();
+
+    for(unsigned int i = 0; i < _entries.size(); i++)
+    {
+        MutexHandle handle(&_mutex);
+        _processing = _entries[i]->connection;
+        handle.release();
+
+        _entries[i]->connection->processDescriptors(&in_set, &out_set);
+    }
+
+    MutexHandle handle(&_mutex);
+    _processing = NULL;
+}
+
+#endif // ifdef(__linux__)
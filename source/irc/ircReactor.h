@@ -0,0 +1,143 @@
+#ifndef _IRC_REACTOR_H_
+#define _IRC_REACTOR_H_
+#include <vector>
+#include <map>
+#include <util/threadHelper.h>
+#include <util/util.h>
+#include <util/wakeupChannel.h>
+
+//ircReactor.h
+//Author: Simon Wittenberg
+
+// The IrcReactor drives any number of IrcConnections from a small, fixed number of
+// threads instead of one thread per connection. Each IrcReactorLoop owns one thread
+// and an epoll set (select on platforms without epoll), connections are spread over
+// the loops and are driven through irc_add_select_descriptors/irc_process_select_descriptors.
+//
+// Usage:
+//      IrcReactor reactor;                 // one loop per core
+//      reactor.start();
+//      bot.attachTo(&reactor, &serverInfo);  // instead of bot.start(&serverInfo)
+
+class IrcConnection;
+class IrcReactorLoop;
+
+class IrcReactor
+{
+public:
+    // loopCount == 0 starts one loop per processor core
+    IrcReactor(unsigned int loopCount = 0);
+    ~IrcReactor();
+
+    // starts the threads of all loops
+    int start();
+
+    // stops and joins all loops, the connections are detached but not disconnected
+    void stop();
+
+    bool isRunning(){ MutexHandle handle(&_mutex); return _running; };
+
+    // internal function only do not use directly!
+    // use IrcConnection::attachTo(...) instead.
+    // hands the connection to the loop with the fewest connections and returns it
+    IrcReactorLoop* add(IrcConnection* connection);
+
+    // detaches the connection from its loop, it is not disconnected
+    void remove(IrcConnection* connection);
+
+    unsigned int getLoopCount(){ return _loops.size(); };
+    unsigned int getConnectionCount();
+
+private:
+    std::vector<IrcReactorLoop*>    _loops;
+    bool                            _running;
+    IRC_MUTEX_HANDLE                _mutex;
+};
+
+
+class IrcReactorLoop
+{
+public:
+    IrcReactorLoop();
+    ~IrcReactorLoop();
+
+    int start();
+    void stop();
+
+    // connections are adopted/dropped by the loop thread on its next iteration
+    void add(IrcConnection* connection);
+    void remove(IrcConnection* connection);
+    // like remove(...), but only returns once the loop let go of the connection, so it can
+    // be deleted right after, see IrcConnection::detach(). Must not be called on the loop's
+    // own thread, it would wait for itself: connections are not deleted from callbacks
+    void detach(IrcConnection* connection);
+
+    // called by connections that queued something to send from outside of the loop,
+    // the loop re-arms them right away instead of on its next housekeeping
+    void wake(IrcConnection* connection);
+
+    unsigned int getConnectionCount(){ MutexHandle handle(&_mutex); return _connectionCount; };
+
+    // internal function only do not use directly!
+    // this is the method that is run in the thread.
+    void run();
+
+private:
+    struct Entry
+    {
+        IrcConnection*  connection;
+        int             fd;
+        unsigned int    events;
+        unsigned int    generation;
+        bool            timed;
+    };
+
+    // a thread in detach(...) waiting for _drop(...) to let go of connection
+    struct Detach
+    {
+        IrcConnection*  connection;
+        EventHandle*    dropped;
+    };
+
+    void _adoptPending();
+    void _drop(unsigned int index);
+    void _housekeeping(millis_t now);
+    void _runOnce(millis_t now);
+    void _takeWoken();
+#if defined (__linux__)
+    void _fireTimers(millis_t now);
+    void _arm(Entry* entry);
+    void _process(Entry* entry, bool readable, bool writable);
+#endif
+
+    std::vector<Entry*>             _entries;
+    std::vector<IrcConnection*>     _pendingAdds;
+    std::vector<IrcConnection*>     _pendingRemoves;
+    std::vector<IrcConnection*>     _woken;
+    std::vector<Detach>             _detaching;
+    std::map<IrcConnection*, Entry*> _index;
+    IrcConnection*                  _processing;
+    bool                            _wakePending;
+    WakeupChannel                   _wakeup;
+    unsigned int                    _connectionCount;
+    millis_t                        _nextHousekeeping;
+    bool                            _running;
+    thread_handle_t                 _thread;
+    // the id of _thread once run() started, see detach(...)
+    thread_id_t                     _threadId;
+    bool                            _threadKnown;
+    IRC_MUTEX_HANDLE                _mutex;
+
+#if defined (__linux__)
+    int                             _epollFd;
+    // bitmaps large enough for every descriptor of the process, see ircReactor.cpp
+    fd_set*                         _inSet;
+    fd_set*                         _outSet;
+    std::vector<Entry*>             _active;
+    // connections whose flood control holds back lines, re-armed at _nextTimer
+    std::vector<Entry*>             _timers;
+    millis_t                        _nextTimer;
+#endif
+};
+
+#endif //_IRC_REACTOR_H_
@@ -0,0 +1,111 @@
+#include "ircSendQueue.h"
+#include <errno.h>
+
+#if defined (WIN32)
+    #include <winsock2.h>
+#else
+    #include <sys/types.h>
+    #include <sys/uio.h>
+#endif
+
+//ircSendQueue.cpp
+//Author: Simon Wittenberg
+
+
+IrcSendQueue::IrcSendQueue()
+{
+    _offset = 0;
+    _size = 0;
+}
+
+void IrcSendQueue::push(IrcOutboundLine& line)
+{
+    _size += line.length() + 2;
+    _lines.push_back(IrcOutboundLine());
+    _lines.back().swap(line);
+}
+
+int IrcSendQueue::write(int socket)
+{
+    while(_lines.size())
+    {
+#if defined (WIN32)
+        WSABUF buffers[IRC_SEND_QUEUE_IOV];
+#else
+        struct iovec buffers[IRC_SEND_QUEUE_IOV];
+#endif
+        unsigned int count = 0;
+        size_t total = 0;
+        size_t skip = _offset;
+        for(std::deque<IrcOutboundLine>::iterator i = _lines.begin(); i != _lines.end() && count + 4 <= IRC_SEND_QUEUE_IOV; ++i)
+        {
+            IrcStringView pieces[4];
+            pieces[0] = IrcStringView(i->head.data(), i->head.size());
+            pieces[1] = i->body();
+            pieces[2] = i->tail;
+            pieces[3] = IrcStringView("\r\n", 2);
+            for(unsigned int j = 0; j < 4; j++)
+            {
+                // what a partial write left of the first line
+                if(skip >= pieces[j].size)
+                {
+                    skip -= pieces[j].size;
+                    continue;
+                }
+#if defined (WIN32)
+                buffers[count].buf = (char*) pieces[j].data + skip;
+                buffers[count].len = (ULONG)(pieces[j].size - skip);
+#else
+                buffers[count].iov_base = (void*)(pieces[j].data + skip);
+                buffers[count].iov_len = pieces[j].size - skip;
+#endif
+                total += pieces[j].size - skip;
+                skip = 0;
+                count++;
+            }
+        }
+
+#if defined (WIN32)
+        DWORD sent = 0;
+        if(WSASend(socket, buffers, count, &sent, 0, NULL, NULL) != 0)
+        {
+            int error = WSAGetLastError();
+            return (error == WSAEWOULDBLOCK || error == WSAEINTR) ? 0 : -1;
+        }
+#else
+        ssize_t sent = writev(socket, buffers, count);
+        if(sent < 0)
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+#endif
+        _consume((size_t)sent);
+
+        // the socket is full, the next round goes on where this one stopped
+        if((size_t)sent < total)
+            return 0;
+    }
+    return 0;
+}
+
+void IrcSendQueue::_consume(size_t bytes)
+{
+    _size -= bytes;
+    while(bytes)
+    {
+        size_t left = _lines.front().length() + 2 - _offset;
+        if(bytes < left)
+        {
+            _offset += bytes;
+            return;
+        }
+        bytes -= left;
+        _offset = 0;
+        _lines.pop_front();
+    }
+}
+
+void IrcSendQueue::clear()
+{
+    _lines.clear();
+    _offset = 0;
+    _size = 0;
+}
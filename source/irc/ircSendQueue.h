@@ -0,0 +1,47 @@
+#ifndef _IRC_SEND_QUEUE_H_
+#define _IRC_SEND_QUEUE_H_
+#include <string>
+#include <deque>
+#include <irc/ircPayload.h>
+
+//ircSendQueue.h
+//Author: Simon Wittenberg
+
+// The lines on their way to the socket of a native session, see IrcConnection::setNativeInput(...).
+// Every line keeps its own buffers, write(...) hands the head, payload and tail of as many
+// of them as it can to a single writev (WSASend on windows). A partial write only advances
+// the offset into the first line, nothing is moved around.
+// Not thread safe, IrcConnection guards it with its inner mutex.
+
+// the most buffers a single write(...) hands to the socket, up to 4 per line
+#define IRC_SEND_QUEUE_IOV  256
+
+class IrcSendQueue
+{
+public:
+    IrcSendQueue();
+
+    // takes over line, without its line end, and leaves it empty
+    void push(IrcOutboundLine& line);
+
+    // writes as much as the socket takes without blocking,
+    // returns -1 if the connection is broken, 0 otherwise
+    int write(int socket);
+
+    // drops everything, including the rest of a line that is written partially
+    void clear();
+
+    bool empty() const { return _lines.empty(); };
+    // bytes left to write
+    size_t size() const { return _size; };
+
+private:
+    void _consume(size_t bytes);
+
+    std::deque<IrcOutboundLine> _lines;
+    // how much of the first line is written already
+    size_t                      _offset;
+    size_t                      _size;
+};
+
+#endif //_IRC_SEND_QUEUE_H_
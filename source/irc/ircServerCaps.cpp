@@ -0,0 +1,342 @@
+#include "ircServerCaps.h"
+#include <irc/ircParser.h>
+#include <util/util.h>
+
+//ircServerCaps.cpp
+//Author: Simon Wittenberg
+
+
+// "12" -> 12, an empty value means no limit
+static unsigned int irc_caps_number(const IrcStringView& value)
+{
+    Unless(value.size)
+        return IRC_CAPS_UNLIMITED;
+    unsigned int number = 0;
+    for(size_t i = 0; i < value.size && value[i] >= '0' && value[i] <= '9'; i++)
+        number = number * 10 + (value[i] - '0');
+    return number;
+}
+
+IrcServerCaps::IrcServerCaps()
+{
+    reset();
+}
+
+void IrcServerCaps::reset()
+{
+    for(unsigned int i = 0; i < IRC_COMMAND_COUNT; i++)
+        _targetMax[i] = 0;
+    _hasTargMax = false;
+    _maxTargets = 1;
+    _modes = IRC_CAPS_DEFAULT_MODES;
+    _parsePrefix(IrcStringView(IRC_CAPS_DEFAULT_PREFIX));
+    _parseChanModes(IrcStringView(IRC_CAPS_DEFAULT_CHANMODES));
+    _caseMapping.setType(IRC_CASEMAPPING_RFC1459);
+    _nickLength = IRC_CAPS_UNLIMITED;
+    _lineLength = IRC_CAPS_DEFAULT_LINELEN;
+    _parseChanTypes(IrcStringView(IRC_CAPS_DEFAULT_CHANTYPES));
+    _chanLimitCount = 0;
+}
+
+bool IrcServerCaps::equals(const IrcServerCaps& other) const
+{
+    return memcmp(_targetMax, other._targetMax, sizeof(_targetMax)) == 0
+        && _hasTargMax == other._hasTargMax
+        && _maxTargets == other._maxTargets
+        && _modes == other._modes
+        && _prefixCount == other._prefixCount
+        && memcmp(_prefixModes, other._prefixModes, _prefixCount) == 0
+        && memcmp(_prefixChars, other._prefixChars, _prefixCount) == 0
+        && memcmp(_modeTypes, other._modeTypes, sizeof(_modeTypes)) == 0
+        && _caseMapping == other._caseMapping
+        && _nickLength == other._nickLength
+        && _lineLength == other._lineLength
+        && _chanTypeCount == other._chanTypeCount
+        && memcmp(_chanTypes, other._chanTypes, _chanTypeCount) == 0
+        && _chanLimitCount == other._chanLimitCount
+        && memcmp(_chanLimitTypes, other._chanLimitTypes, _chanLimitCount) == 0
+        && memcmp(_chanLimits, other._chanLimits, _chanLimitCount * sizeof(unsigned int)) == 0
+        && memcmp(_chanLimitGroups, other._chanLimitGroups, _chanLimitCount) == 0;
+}
+
+void IrcServerCaps::parseIsupport(const IrcMessageView& message)
+{
+    // "<our nick> TOKEN TOKEN=value -TOKEN ... :are supported by this server"
+    for(unsigned int i = 1; i + 1 < message.count; i++)
+    {
+        IrcStringView token = message.params[i];
+        bool negated = token.size && token[0] == '-';
+        if(negated)
+            token = IrcStringView(token.data + 1, token.size - 1);
+
+        size_t equals = token.find("=");
+        if(equals == IrcStringView::npos)
+            _parseToken(token, IrcStringView(), negated);
+        else
+            _parseToken(IrcStringView(token.data, equals), IrcStringView(token.data + equals + 1, token.size - equals - 1), negated);
+    }
+}
+
+void IrcServerCaps::_parseToken(const IrcStringView& key, const IrcStringView& value, bool negated)
+{
+    if(key.equals("TARGMAX"))
+    {
+        for(unsigned int i = 0; i < IRC_COMMAND_COUNT; i++)
+            _targetMax[i] = 0;
+        _hasTargMax = !negated;
+        if(!negated)
+            _parseTargMax(value);
+    }
+    else if(key.equals("MAXTARGETS"))
+    {
+        _maxTargets = negated ? 1 : irc_caps_number(value);
+    }
+    else if(key.equals("MODES"))
+    {
+        _modes = negated ? IRC_CAPS_DEFAULT_MODES : irc_caps_number(value);
+    }
+    else if(key.equals("PREFIX"))
+    {
+        _parsePrefix(negated ? IrcStringView(IRC_CAPS_DEFAULT_PREFIX) : value);
+    }
+    else if(key.equals("CHANMODES"))
+    {
+        _parseChanModes(negated ? IrcStringView(IRC_CAPS_DEFAULT_CHANMODES) : value);
+    }
+    else if(key.equals("CASEMAPPING"))
+    {
+        if(negated)
+            _caseMapping.setType(IRC_CASEMAPPING_RFC1459);
+        else
+            _caseMapping.setName(value);
+    }
+    else if(key.equals("NICKLEN"))
+    {
+        _nickLength = negated ? IRC_CAPS_UNLIMITED : irc_caps_number(value);
+    }
+    else if(key.equals("LINELEN"))
+    {
+        unsigned int length = negated ? IRC_CAPS_DEFAULT_LINELEN : irc_caps_number(value);
+        // shorter than RFC 1459 allows can only be a typo
+        if(length < IRC_CAPS_DEFAULT_LINELEN)
+            length = IRC_CAPS_DEFAULT_LINELEN;
+        _lineLength = length < IRC_CAPS_MAX_LINELEN ? length : IRC_CAPS_MAX_LINELEN;
+    }
+    else if(key.equals("CHANTYPES"))
+    {
+        _parseChanTypes(negated ? IrcStringView(IRC_CAPS_DEFAULT_CHANTYPES) : value);
+    }
+    else if(key.equals("CHANLIMIT"))
+    {
+        _chanLimitCount = 0;
+        if(!negated)
+            _parseChanLimit(value);
+    }
+    else if(key.equals("MAXCHANNELS"))
+    {
+        // the older token, one limit for all channels. CHANLIMIT wins if both are sent
+        if(negated || value.empty())
+            _chanLimitCount = 0;
+        else if(_chanLimitCount == 0)
+        {
+            size_t count = _chanTypeCount;
+            for(size_t i = 0; i < count; i++)
+            {
+                _chanLimitTypes[i] = _chanTypes[i];
+                _chanLimits[i] = irc_caps_number(value);
+                _chanLimitGroups[i] = 0;
+            }
+            _chanLimitCount = (unsigned int)count;
+        }
+    }
+}
+
+void IrcServerCaps::_parseTargMax(const IrcStringView& value)
+{
+    // "PRIVMSG:4,NOTICE:4,JOIN:", commands without a number have no limit
+    IrcStringView rest = value;
+    while(rest.size)
+    {
+        size_t comma = rest.find(",");
+        IrcStringView entry(rest.data, comma == IrcStringView::npos ? rest.size : comma);
+        rest = comma == IrcStringView::npos ? IrcStringView() : IrcStringView(rest.data + comma + 1, rest.size - comma - 1);
+
+        size_t colon = entry.find(":");
+        if(colon == IrcStringView::npos)
+            continue;
+        IrcCommand command = IrcParser::lookupCommand(IrcStringView(entry.data, colon));
+        if(command != IRC_COMMAND_UNKNOWN)
+            _targetMax[command] = irc_caps_number(IrcStringView(entry.data + colon + 1, entry.size - colon - 1));
+    }
+}
+
+void IrcServerCaps::_parsePrefix(const IrcStringView& value)
+{
+    // "(qaohv)~&@%+", the modes and their prefixes in the same order, highest first.
+    // An empty value means the server has no prefixes at all
+    _prefixCount = 0;
+    size_t close = value.find(")");
+    if(value.size == 0 || value[0] != '(' || close == IrcStringView::npos)
+        return;
+    size_t modes = close - 1;
+    size_t chars = value.size - close - 1;
+    size_t count = modes < chars ? modes : chars;
+    if(count > IRC_CAPS_MAX_PREFIXES)
+        count = IRC_CAPS_MAX_PREFIXES;
+    for(size_t i = 0; i < count; i++)
+    {
+        _prefixModes[i] = value[1 + i];
+        _prefixChars[i] = value[close + 1 + i];
+    }
+    _prefixCount = (unsigned int)count;
+}
+
+void IrcServerCaps::_parseChanModes(const IrcStringView& value)
+{
+    // "A,B,C,D": lists, always a parameter, a parameter only when set, never a parameter
+    memset(_modeTypes, 0, sizeof(_modeTypes));
+    char type = 'A';
+    for(size_t i = 0; i < value.size && type <= 'D'; i++)
+    {
+        unsigned char mode = (unsigned char)value[i];
+        if(mode == ',')
+            type++;
+        else if(mode < sizeof(_modeTypes))
+            _modeTypes[mode] = type;
+    }
+}
+
+void IrcServerCaps::_parseChanTypes(const IrcStringView& value)
+{
+    // "#&", empty if the server has no channels at all
+    size_t count = value.size < IRC_CAPS_MAX_CHANTYPES ? value.size : IRC_CAPS_MAX_CHANTYPES;
+    memcpy(_chanTypes, value.data, count);
+    _chanTypeCount = (unsigned int)count;
+}
+
+void IrcServerCaps::_parseChanLimit(const IrcStringView& value)
+{
+    // "#&:10,+:", prefixes without a number have no limit
+    IrcStringView rest = value;
+    unsigned char group = 0;
+    while(rest.size)
+    {
+        size_t comma = rest.find(",");
+        IrcStringView entry(rest.data, comma == IrcStringView::npos ? rest.size : comma);
+        rest = comma == IrcStringView::npos ? IrcStringView() : IrcStringView(rest.data + comma + 1, rest.size - comma - 1);
+
+        size_t colon = entry.find(":");
+        if(colon == IrcStringView::npos)
+            continue;
+        unsigned int limit = irc_caps_number(IrcStringView(entry.data + colon + 1, entry.size - colon - 1));
+        for(size_t i = 0; i < colon && _chanLimitCount < IRC_CAPS_MAX_CHANTYPES; i++)
+        {
+            _chanLimitTypes[_chanLimitCount] = entry[i];
+            _chanLimits[_chanLimitCount] = limit;
+            _chanLimitGroups[_chanLimitCount] = group;
+            _chanLimitCount++;
+        }
+        group++;
+    }
+}
+
+bool IrcServerCaps::isChannel(const IrcStringView& name) const
+{
+    Return_False_Unless(name.size);
+    for(unsigned int i = 0; i < _chanTypeCount; i++)
+        if(_chanTypes[i] == name[0])
+            return true;
+    return false;
+}
+
+int IrcServerCaps::_findChanLimit(char type) const
+{
+    for(unsigned int i = 0; i < _chanLimitCount; i++)
+        if(_chanLimitTypes[i] == type)
+            return (int)i;
+    return -1;
+}
+
+unsigned int IrcServerCaps::getChannelLimit(const IrcStringView& channel) const
+{
+    int index = channel.size ? _findChanLimit(channel[0]) : -1;
+    return index >= 0 ? _chanLimits[index] : IRC_CAPS_UNLIMITED;
+}
+
+bool IrcServerCaps::sharesChannelLimit(const IrcStringView& channel, const IrcStringView& other) const
+{
+    Return_False_Unless(channel.size && other.size);
+    int index = _findChanLimit(channel[0]);
+    int otherIndex = _findChanLimit(other[0]);
+    return index >= 0 && otherIndex >= 0 && _chanLimitGroups[index] == _chanLimitGroups[otherIndex];
+}
+
+int IrcServerCaps::findPrefixMode(char mode) const
+{
+    for(unsigned int i = 0; i < _prefixCount; i++)
+        if(_prefixModes[i] == mode)
+            return (int)i;
+    return -1;
+}
+
+int IrcServerCaps::findPrefixChar(char prefix) const
+{
+    for(unsigned int i = 0; i < _prefixCount; i++)
+        if(_prefixChars[i] == prefix)
+            return (int)i;
+    return -1;
+}
+
+bool IrcServerCaps::modeTakesParam(char mode, bool set) const
+{
+    if(findPrefixMode(mode) >= 0)
+        return true;
+    unsigned char index = (unsigned char)mode;
+    Return_False_Unless(index < sizeof(_modeTypes));
+    switch(_modeTypes[index])
+    {
+    case 'A':
+    case 'B':   return true;
+    case 'C':   return set;
+    default:    return false;
+    }
+}
+
+unsigned int IrcServerCaps::getTargetMax(IrcCommand command) const
+{
+    if(_hasTargMax)
+        return _targetMax[command] ? _targetMax[command] : 1;
+    // MAXTARGETS is the older token, it only ever applied to messages and notices
+    if(command == IRC_COMMAND_PRIVMSG || command == IRC_COMMAND_NOTICE)
+        return _maxTargets ? _maxTargets : 1;
+    return 1;
+}
+
+
+IrcServerCapsHandle::IrcServerCapsHandle(IrcServerCaps* caps)
+{
+    _block = new Block();
+    _block->references = 1;
+    _block->caps = caps;
+}
+
+IrcServerCapsHandle::IrcServerCapsHandle(const IrcServerCapsHandle& other)
+{
+    _block = other._block;
+    if(_block)
+        ATOMIC_INCREMENT(_block->references);
+}
+
+IrcServerCapsHandle::~IrcServerCapsHandle()
+{
+    Return_Void_Unless(_block && ATOMIC_DECREMENT(_block->references) == 0);
+    delete _block->caps;
+    delete _block;
+}
+
+IrcServerCapsHandle& IrcServerCapsHandle::operator=(const IrcServerCapsHandle& other)
+{
+    IrcServerCapsHandle copy(other);
+    swap(copy);
+    return *this;
+}
@@ -0,0 +1,158 @@
+#ifndef _IRC_SERVER_CAPS_H_
+#define _IRC_SERVER_CAPS_H_
+#include <util/threadHelper.h>
+#include <irc/ircMessage.h>
+#include <irc/ircCaseMapping.h>
+
+//ircServerCaps.h
+//Author: Simon Wittenberg
+
+// What the server told us about itself in RPL_ISUPPORT (005), the limits outgoing
+// commands have to respect. Servers send several 005 lines, each of them is applied
+// on top of what we have, a "-TOKEN" resets a token to its default.
+// IrcConnection never changes a copy it handed out, every 005 line gets applied to a new
+// one which then replaces the old, see IrcConnection::getServerCaps(). The copies are
+// reference counted, the old one goes once its last IrcServerCapsHandle does.
+
+// no limit, e.g. "TARGMAX=JOIN:"
+#define IRC_CAPS_UNLIMITED ((unsigned int)-1)
+
+// mode changes with a parameter per MODE command if the server does not say, RFC 1459
+#define IRC_CAPS_DEFAULT_MODES 3
+
+// channel member prefixes and channel modes if the server does not say, RFC 1459
+#define IRC_CAPS_DEFAULT_PREFIX     "(ov)@+"
+#define IRC_CAPS_DEFAULT_CHANMODES  "beI,k,l,imnpst"
+// the most member prefixes we keep, as many as there are bits in a byte
+#define IRC_CAPS_MAX_PREFIXES 8
+
+// the longest line including its line end, RFC 1459 unless the server says more. We
+// never use more than libirc can send
+#define IRC_CAPS_DEFAULT_LINELEN 512
+#define IRC_CAPS_MAX_LINELEN 1024
+// channel prefixes if the server does not say, RFC 1459
+#define IRC_CAPS_DEFAULT_CHANTYPES "#&"
+#define IRC_CAPS_MAX_CHANTYPES 8
+
+class IrcServerCaps
+{
+public:
+    IrcServerCaps();
+
+    // back to the defaults, for a new session
+    void reset();
+
+    // applies the tokens of a RPL_ISUPPORT reply
+    void parseIsupport(const IrcMessageView& message);
+
+    // whether both say the same about the server
+    bool equals(const IrcServerCaps& other) const;
+
+    // how many targets a single command may carry, from TARGMAX or MAXTARGETS.
+    // 1 if the server did not say, IRC_CAPS_UNLIMITED if it has no limit
+    unsigned int getTargetMax(IrcCommand command) const;
+
+    // how many mode changes with a parameter a single MODE command may carry, from MODES.
+    // IRC_CAPS_UNLIMITED if it has no limit
+    unsigned int getModesMax() const { return _modes; };
+
+    // the member prefixes from PREFIX, highest first, e.g. 'o' and '@' for index 0
+    unsigned int getPrefixCount() const { return _prefixCount; };
+    char getPrefixMode(unsigned int index) const { return _prefixModes[index]; };
+    char getPrefixChar(unsigned int index) const { return _prefixChars[index]; };
+    // the index of a member mode like 'o' or of its prefix like '@', -1 for anything else
+    int findPrefixMode(char mode) const;
+    int findPrefixChar(char prefix) const;
+
+    // whether a channel mode change comes with a parameter, from CHANMODES and PREFIX
+    // params:
+    // char mode            - the mode, e.g. 'k'
+    // bool set             - '+' or '-', some modes only take one when they are set
+    bool modeTakesParam(char mode, bool set) const;
+
+    // how nicks and channel names compare, from CASEMAPPING
+    const IrcCaseMapping& getCaseMapping() const { return _caseMapping; };
+
+    // the longest nick we may take, from NICKLEN. IRC_CAPS_UNLIMITED if the server does not
+    // say, RFC 1459 has 9 but servers that keep to it say so
+    unsigned int getNickLength() const { return _nickLength; };
+
+    // the longest line the server takes, including its line end, from LINELEN
+    unsigned int getLineLength() const { return _lineLength; };
+    // the same without the line end, what the server relays to others
+    size_t getMessageLength() const { return _lineLength - 2; };
+
+    // whether name starts with one of the prefixes of CHANTYPES
+    bool isChannel(const IrcStringView& name) const;
+    // how many channels like this one we may be in at once, from CHANLIMIT (or MAXCHANNELS).
+    // IRC_CAPS_UNLIMITED if the server does not say
+    unsigned int getChannelLimit(const IrcStringView& channel) const;
+    // whether two channels count against the same limit, e.g. "#a" and "&b" with "#&:10"
+    bool sharesChannelLimit(const IrcStringView& channel, const IrcStringView& other) const;
+
+private:
+    void _parseToken(const IrcStringView& key, const IrcStringView& value, bool negated);
+    void _parseTargMax(const IrcStringView& value);
+    void _parsePrefix(const IrcStringView& value);
+    void _parseChanModes(const IrcStringView& value);
+    void _parseChanTypes(const IrcStringView& value);
+    void _parseChanLimit(const IrcStringView& value);
+    // the CHANLIMIT index of a channel prefix, -1 if it has no limit
+    int _findChanLimit(char type) const;
+
+    // 0 for commands TARGMAX does not mention
+    unsigned int    _targetMax[IRC_COMMAND_COUNT];
+    bool            _hasTargMax;
+    unsigned int    _maxTargets;
+    unsigned int    _modes;
+    unsigned int    _prefixCount;
+    char            _prefixModes[IRC_CAPS_MAX_PREFIXES];
+    char            _prefixChars[IRC_CAPS_MAX_PREFIXES];
+    // the CHANMODES type of every ascii mode, 'A' to 'D' or 0 for unknown ones
+    char            _modeTypes[128];
+    IrcCaseMapping  _caseMapping;
+    unsigned int    _nickLength;
+    unsigned int    _lineLength;
+    unsigned int    _chanTypeCount;
+    char            _chanTypes[IRC_CAPS_MAX_CHANTYPES];
+    // CHANLIMIT per prefix, the limit of channels starting with it and the entry
+    // it came from, the prefixes of an entry share their limit
+    unsigned int    _chanLimitCount;
+    char            _chanLimitTypes[IRC_CAPS_MAX_CHANTYPES];
+    unsigned int    _chanLimits[IRC_CAPS_MAX_CHANTYPES];
+    unsigned char   _chanLimitGroups[IRC_CAPS_MAX_CHANTYPES];
+};
+
+// a reference to a published IrcServerCaps, it stays as it is for as long as it is held
+class IrcServerCapsHandle
+{
+public:
+    IrcServerCapsHandle() : _block(NULL) {};
+    // takes ownership of caps
+    explicit IrcServerCapsHandle(IrcServerCaps* caps);
+    IrcServerCapsHandle(const IrcServerCapsHandle& other);
+    ~IrcServerCapsHandle();
+
+    IrcServerCapsHandle& operator=(const IrcServerCapsHandle& other);
+    void swap(IrcServerCapsHandle& other) { Block* block = _block; _block = other._block; other._block = block; };
+
+    // NULL for an empty handle
+    const IrcServerCaps* get() const { return _block ? _block->caps : NULL; };
+    const IrcServerCaps* operator->() const { return _block->caps; };
+    const IrcServerCaps& operator*() const { return *_block->caps; };
+
+    // whether both refer to the same copy, i.e. no 005 line came in between
+    bool operator==(const IrcServerCapsHandle& other) const { return _block == other._block; };
+    bool operator!=(const IrcServerCapsHandle& other) const { return _block != other._block; };
+
+private:
+    struct Block
+    {
+        irc_atomic_t    references;
+        IrcServerCaps*  caps;
+    };
+
+    Block*  _block;
+};
+
+#endif //_IRC_SERVER_CAPS_H_
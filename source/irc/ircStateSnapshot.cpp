@@ -0,0 +1,72 @@
+#include "ircStateSnapshot.h"
+#include <algorithm>
+#include <util/util.h>
+
+//ircStateSnapshot.cpp
+//Author: Simon Wittenberg
+
+
+static bool irc_snapshot_hash_less(const IrcChannelSnapshot::Member& member, unsigned int hash)
+{
+    return member.hash < hash;
+}
+
+static bool irc_snapshot_member_less(const IrcChannelSnapshot::Member& a, const IrcChannelSnapshot::Member& b)
+{
+    return a.hash < b.hash;
+}
+
+IrcChannelSnapshot::~IrcChannelSnapshot()
+{
+    IrcInternPool& pool = IrcInternPool::global();
+    for(size_t i = 0; i < _members.size(); i++)
+        pool.release(_members[i].nick);
+}
+
+void IrcChannelSnapshot::seal()
+{
+    std::sort(_members.begin(), _members.end(), irc_snapshot_member_less);
+}
+
+const IrcChannelSnapshot::Member* IrcChannelSnapshot::find(const IrcStringView& nick) const
+{
+    unsigned int hash = _mapping.hash(nick);
+    std::vector<Member>::const_iterator it = std::lower_bound(_members.begin(), _members.end(), hash, irc_snapshot_hash_less);
+    for(; it != _members.end() && it->hash == hash; ++it)
+        if(_mapping.equals(it->getNick(), nick))
+            return &*it;
+    return NULL;
+}
+
+
+IrcStateSnapshot::IrcStateSnapshot(const IrcStateSnapshot& other)
+{
+    _block = other._block;
+    if(_block)
+        ATOMIC_INCREMENT(_block->references);
+}
+
+IrcStateSnapshot::~IrcStateSnapshot()
+{
+    Return_Void_Unless(_block && ATOMIC_DECREMENT(_block->references) == 0);
+    for(size_t i = 0; i < _block->channels.size(); i++)
+        _block->channels[i]->release();
+    delete _block;
+}
+
+IrcStateSnapshot& IrcStateSnapshot::operator=(const IrcStateSnapshot& other)
+{
+    IrcStateSnapshot copy(other);
+    swap(copy);
+    return *this;
+}
+
+const IrcChannelSnapshot* IrcStateSnapshot::findChannel(const IrcStringView& name) const
+{
+    Return_NULL_Unless(_block);
+    // we are in a few dozen channels at most
+    for(size_t i = 0; i < _block->channels.size(); i++)
+        if(_block->mapping.equals(_block->channels[i]->getName(), name))
+            return _block->channels[i];
+    return NULL;
+}
@@ -0,0 +1,99 @@
+#ifndef _IRC_STATE_SNAPSHOT_H_
+#define _IRC_STATE_SNAPSHOT_H_
+#include <string>
+#include <vector>
+#include <util/threadHelper.h>
+#include <irc/ircMessage.h>
+#include <irc/ircCaseMapping.h>
+#include <irc/ircInternPool.h>
+
+//ircStateSnapshot.h
+//Author: Simon Wittenberg
+
+// Read only copies of the channel state for threads other than the one the connection
+// runs on, see IrcConnection::getStateSnapshot().
+// A snapshot never changes once it is published, walking it takes no lock and does not
+// hold up the connection. The connection publishes a new one after the input that changed
+// something, channels that stayed the same are shared with the previous snapshot instead
+// of being copied again. Snapshots and their channels are reference counted, a reader may
+// keep one as long as it likes, also after the connection is gone.
+// Members are symbols of IrcInternPool::global(), copying a channel copies no text. A
+// channel holds a reference to the symbols of its members until its last reader lets go.
+
+class IrcChannelSnapshot
+{
+public:
+    struct Member
+    {
+        IrcSymbol       nick;
+        // member modes as bits in the order of PREFIX, bit 0 is the highest one
+        unsigned char   modes;
+        // the highest prefix, e.g. '@', 0 for none
+        char            prefix;
+        // the hash of the nick, members are sorted by it
+        unsigned int    hash;
+
+        IrcStringView getNick() const { return IrcInternPool::global().get(nick); };
+    };
+
+    const std::string& getName() const { return _name; };
+    size_t size() const { return _members.size(); };
+    const Member& operator[](size_t index) const { return _members[index]; };
+    // the member with nick, NULL if nick wasn't in the channel
+    const Member* find(const IrcStringView& nick) const;
+
+private:
+    friend class IrcStateTracker;
+    friend class IrcStateSnapshot;
+
+    IrcChannelSnapshot(const std::string& name, const IrcCaseMapping& mapping) : _references(1), _name(name), _mapping(mapping) {};
+    ~IrcChannelSnapshot();
+    void retain() { ATOMIC_INCREMENT(_references); };
+    void release()
+    {
+        if(ATOMIC_DECREMENT(_references) == 0)
+            delete this;
+    };
+    // sorts the members once they are all in
+    void seal();
+
+    irc_atomic_t            _references;
+    std::string             _name;
+    IrcCaseMapping          _mapping;
+    std::vector<Member>     _members;
+};
+
+class IrcStateSnapshot
+{
+public:
+    IrcStateSnapshot() : _block(NULL) {};
+    IrcStateSnapshot(const IrcStateSnapshot& other);
+    ~IrcStateSnapshot();
+
+    IrcStateSnapshot& operator=(const IrcStateSnapshot& other);
+    void swap(IrcStateSnapshot& other) { Block* block = _block; _block = other._block; other._block = block; };
+
+    // the channels we were in
+    size_t getChannelCount() const { return _block ? _block->channels.size() : 0; };
+    const IrcChannelSnapshot& getChannel(size_t index) const { return *_block->channels[index]; };
+    // the channel called name, NULL if we weren't in it
+    const IrcChannelSnapshot* findChannel(const IrcStringView& name) const;
+
+    // whether both are the same snapshot, i.e. nothing changed in between
+    bool operator==(const IrcStateSnapshot& other) const { return _block == other._block; };
+    bool operator!=(const IrcStateSnapshot& other) const { return _block != other._block; };
+
+private:
+    friend class IrcStateTracker;
+
+    struct Block
+    {
+        irc_atomic_t                        references;
+        IrcCaseMapping                      mapping;
+        std::vector<IrcChannelSnapshot*>    channels;
+    };
+
+    Block*  _block;
+};
+
+#endif //_IRC_STATE_SNAPSHOT_H_
@@ -0,0 +1,542 @@
+#include "ircStateTracker.h"
+
+//ircStateTracker.cpp
+//Author: Simon Wittenberg
+
+
+IrcStateTracker::IrcStateTracker()
+{
+    _userCount = 0;
+    _channelCount = 0;
+    _changed = true;
+}
+
+IrcStateTracker::~IrcStateTracker()
+{
+    clear();
+}
+
+void IrcStateTracker::clear()
+{
+    for(size_t i = 0; i < _channels.size(); i++)
+    {
+        if(_channels[i] && _channels[i]->snapshot)
+            _channels[i]->snapshot->release();
+        delete _channels[i];
+    }
+    IrcInternPool& pool = IrcInternPool::global();
+    for(size_t id = 0; id < _userNicks.size(); id++)
+        pool.release(_userNicks[id]);
+    _strings.clear();
+    _userNicks.clear();
+    _userNames.clear();
+    _userHosts.clear();
+    _userNext.clear();
+    _userChannelCounts.clear();
+    _freeUsers.clear();
+    _nicks.clear();
+    _userCount = 0;
+    _channels.clear();
+    _channelHashes.clear();
+    _channelNext.clear();
+    _freeChannels.clear();
+    _channelNames.clear();
+    _channelCount = 0;
+    _changed = true;
+}
+
+void IrcStateTracker::_link(OpenHashMap<unsigned int>& index, unsigned int hash, unsigned int id, std::vector<unsigned int>& next)
+{
+    unsigned int* first = index.find(hash);
+    next[id] = first ? *first : IRC_STATE_NONE;
+    index.set(hash, id);
+}
+
+void IrcStateTracker::_unlink(OpenHashMap<unsigned int>& index, unsigned int hash, unsigned int id, std::vector<unsigned int>& next)
+{
+    unsigned int* link = index.find(hash);
+    Return_Void_Unless(link);
+    if(*link == id)
+    {
+        if(next[id] == IRC_STATE_NONE)
+            index.erase(hash);
+        else
+            *link = next[id];
+        return;
+    }
+    for(unsigned int other = *link; other != IRC_STATE_NONE; other = next[other])
+    {
+        if(next[other] == id)
+        {
+            next[other] = next[id];
+            return;
+        }
+    }
+}
+
+void IrcStateTracker::setCaseMapping(const IrcCaseMapping& mapping)
+{
+    Return_Void_Unless(mapping != _mapping);
+    _mapping = mapping;
+    _nicks.clear();
+    for(unsigned int id = 0; id < _userNicks.size(); id++)
+    {
+        if(_userNicks[id] != IRC_SYMBOL_NONE)
+            _link(_nicks, _mapping.hash(_nick(id)), id, _userNext);
+    }
+    _channelNames.clear();
+    for(unsigned int id = 0; id < _channels.size(); id++)
+    {
+        if(!_channels[id])
+            continue;
+        const std::string& name = _channels[id]->name;
+        _channelHashes[id] = _mapping.hash(IrcStringView(name.data(), name.size()));
+        _link(_channelNames, _channelHashes[id], id, _channelNext);
+        _touch(id);
+    }
+    _changed = true;
+}
+
+unsigned int IrcStateTracker::_findUser(const IrcStringView& nick) const
+{
+    const unsigned int* first = _nicks.find(_mapping.hash(nick));
+    for(unsigned int id = first ? *first : IRC_STATE_NONE; id != IRC_STATE_NONE; id = _userNext[id])
+        if(_mapping.equals(_nick(id), nick))
+            return id;
+    return IRC_STATE_NONE;
+}
+
+unsigned int IrcStateTracker::_findChannel(const IrcStringView& name) const
+{
+    const unsigned int* first = _channelNames.find(_mapping.hash(name));
+    for(unsigned int id = first ? *first : IRC_STATE_NONE; id != IRC_STATE_NONE; id = _channelNext[id])
+        if(_mapping.equals(_channels[id]->name, name))
+            return id;
+    return IRC_STATE_NONE;
+}
+
+unsigned int IrcStateTracker::_addUser(const IrcStringView& nick)
+{
+    unsigned int id;
+    if(_freeUsers.size())
+    {
+        id = _freeUsers.back();
+        _freeUsers.pop_back();
+    }
+    else
+    {
+        id = (unsigned int)_userNicks.size();
+        _userNicks.push_back(IRC_SYMBOL_NONE);
+        _userNames.push_back(IRC_STRING_NONE);
+        _userHosts.push_back(IRC_STRING_NONE);
+        _userNext.push_back(IRC_STATE_NONE);
+        _userChannelCounts.push_back(0);
+    }
+    _userNicks[id] = IrcInternPool::global().intern(nick);
+    _link(_nicks, _mapping.hash(nick), id, _userNext);
+    _userCount++;
+    return id;
+}
+
+unsigned int IrcStateTracker::_addChannel(const IrcStringView& name)
+{
+    unsigned int id;
+    if(_freeChannels.size())
+    {
+        id = _freeChannels.back();
+        _freeChannels.pop_back();
+    }
+    else
+    {
+        id = (unsigned int)_channels.size();
+        _channels.push_back(NULL);
+        _channelHashes.push_back(0);
+        _channelNext.push_back(IRC_STATE_NONE);
+    }
+    Channel* channel = new Channel();
+    channel->name.assign(name.data, name.size);
+    channel->snapshot = NULL;
+    _channels[id] = channel;
+    _channelHashes[id] = _mapping.hash(name);
+    _link(_channelNames, _channelHashes[id], id, _channelNext);
+    _channelCount++;
+    _changed = true;
+    return id;
+}
+
+unsigned int IrcStateTracker::_nextChannel(unsigned int user, unsigned int channel) const
+{
+    Unless(_userChannelCounts[user])
+        return IRC_STATE_NONE;
+    for(; channel < _channels.size(); channel++)
+        if(_channels[channel] && _channels[channel]->members.find(user))
+            return channel;
+    return IRC_STATE_NONE;
+}
+
+void IrcStateTracker::_setName(unsigned int* id, const IrcStringView& name)
+{
+    Return_Void_Unless(name.size);
+    // the new one first, the same text must not go away in between
+    unsigned int next = _strings.intern(name);
+    if(*id != IRC_STRING_NONE)
+        _strings.release(*id);
+    *id = next;
+}
+
+void IrcStateTracker::_freeUser(unsigned int id)
+{
+    _unlink(_nicks, _mapping.hash(_nick(id)), id, _userNext);
+    if(_userNames[id] != IRC_STRING_NONE)
+        _strings.release(_userNames[id]);
+    if(_userHosts[id] != IRC_STRING_NONE)
+        _strings.release(_userHosts[id]);
+    // snapshots that still show the user hold references of their own
+    IrcInternPool::global().release(_userNicks[id]);
+    _userNicks[id] = IRC_SYMBOL_NONE;
+    _userNames[id] = IRC_STRING_NONE;
+    _userHosts[id] = IRC_STRING_NONE;
+    _freeUsers.push_back(id);
+    _userCount--;
+}
+
+void IrcStateTracker::_dropUser(unsigned int id)
+{
+    for(unsigned int channel = _nextChannel(id, 0); channel != IRC_STATE_NONE; channel = _nextChannel(id, channel + 1))
+    {
+        _channels[channel]->members.erase(id);
+        _touch(channel);
+    }
+    _userChannelCounts[id] = 0;
+    _freeUser(id);
+}
+
+void IrcStateTracker::_dropChannel(unsigned int id)
+{
+    Channel* channel = _channels[id];
+    // everyone who was only known from here goes with it
+    for(size_t slot = 0; slot < channel->members.capacity(); slot++)
+    {
+        Unless(channel->members.occupied(slot))
+            continue;
+        unsigned int member = channel->members.keyAt(slot);
+        Unless(--_userChannelCounts[member])
+            _freeUser(member);
+    }
+    _unlink(_channelNames, _channelHashes[id], id, _channelNext);
+    if(channel->snapshot)
+        channel->snapshot->release();
+    delete channel;
+    _channels[id] = NULL;
+    _freeChannels.push_back(id);
+    _channelCount--;
+    _changed = true;
+}
+
+void IrcStateTracker::_touch(unsigned int channel)
+{
+    Channel* entry = _channels[channel];
+    if(entry->snapshot)
+    {
+        entry->snapshot->release();
+        entry->snapshot = NULL;
+    }
+    _changed = true;
+}
+
+void IrcStateTracker::_touchUser(unsigned int user)
+{
+    for(unsigned int channel = _nextChannel(user, 0); channel != IRC_STATE_NONE; channel = _nextChannel(user, channel + 1))
+        _touch(channel);
+}
+
+void IrcStateTracker::_addMember(unsigned int channel, unsigned int user, unsigned char modes)
+{
+    OpenHashMap<unsigned char>& members = _channels[channel]->members;
+    Unless(members.find(user))
+        _userChannelCounts[user]++;
+    members.set(user, modes);
+    _touch(channel);
+}
+
+void IrcStateTracker::_removeMember(unsigned int channel, unsigned int user)
+{
+    Return_Void_Unless(_channels[channel]->members.erase(user));
+    _touch(channel);
+    Unless(--_userChannelCounts[user])
+        _freeUser(user);
+}
+
+unsigned int IrcStateTracker::_join(unsigned int channel, const IrcPrefix& who, unsigned char modes)
+{
+    unsigned int id = _findUser(who.nick);
+    if(id == IRC_STATE_NONE)
+        id = _addUser(who.nick);
+    _setName(&_userNames[id], who.user);
+    _setName(&_userHosts[id], who.host);
+    _addMember(channel, id, modes);
+    return id;
+}
+
+void IrcStateTracker::onJoin(const IrcStringView& channel, const IrcPrefix& who, bool self)
+{
+    Return_Void_Unless(channel.size && who.nick.size);
+    unsigned int id = _findChannel(channel);
+    if(id == IRC_STATE_NONE)
+    {
+        // joins to channels we aren't in are news about our own join only
+        Return_Void_Unless(self);
+        id = _addChannel(channel);
+    }
+    _join(id, who, 0);
+}
+
+void IrcStateTracker::onPart(const IrcStringView& channel, const IrcStringView& nick, bool self)
+{
+    unsigned int id = _findChannel(channel);
+    Return_Void_Unless(id != IRC_STATE_NONE);
+    if(self)
+    {
+        _dropChannel(id);
+        return;
+    }
+    unsigned int user = _findUser(nick);
+    if(user != IRC_STATE_NONE)
+        _removeMember(id, user);
+}
+
+void IrcStateTracker::onQuit(const IrcStringView& nick)
+{
+    unsigned int id = _findUser(nick);
+    if(id != IRC_STATE_NONE)
+        _dropUser(id);
+}
+
+void IrcStateTracker::onNick(const IrcStringView& nick, const IrcStringView& newNick)
+{
+    unsigned int id = _findUser(nick);
+    Return_Void_Unless(id != IRC_STATE_NONE && newNick.size);
+    // whoever we still think has the new nick is gone
+    unsigned int other = _findUser(newNick);
+    if(other != IRC_STATE_NONE && other != id)
+        _dropUser(other);
+
+    _unlink(_nicks, _mapping.hash(_nick(id)), id, _userNext);
+    // the new one first, a change of case may keep the same text
+    IrcInternPool& pool = IrcInternPool::global();
+    IrcSymbol nickSymbol = pool.intern(newNick);
+    pool.release(_userNicks[id]);
+    _userNicks[id] = nickSymbol;
+    _link(_nicks, _mapping.hash(newNick), id, _userNext);
+    _touchUser(id);
+}
+
+void IrcStateTracker::onNames(const IrcStringView& channel, const IrcStringView& names, const IrcServerCaps& caps)
+{
+    // NAMES of channels we aren't in don't tell us anything we keep
+    unsigned int id = _findChannel(channel);
+    Return_Void_Unless(id != IRC_STATE_NONE);
+
+    const char* p = names.data;
+    const char* end = names.data + names.size;
+    while(p < end)
+    {
+        while(p < end && *p == ' ')
+            p++;
+        const char* word = p;
+        while(p < end && *p != ' ')
+            p++;
+
+        unsigned char modes = 0;
+        int prefix;
+        while(word < p && (prefix = caps.findPrefixChar(*word)) >= 0)
+        {
+            modes |= (unsigned char)(1 << prefix);
+            word++;
+        }
+        IrcPrefix who(IrcStringView(word, p - word));
+        if(who.nick.size)
+            _join(id, who, modes);
+    }
+}
+
+void IrcStateTracker::onMode(const IrcMessageView& message, const IrcServerCaps& caps)
+{
+    unsigned int id = _findChannel(message.param(0));
+    Return_Void_Unless(id != IRC_STATE_NONE);
+    OpenHashMap<unsigned char>& members = _channels[id]->members;
+
+    IrcStringView modes = message.param(1);
+    unsigned int param = 2;
+    bool set = true;
+    for(size_t i = 0; i < modes.size; i++)
+    {
+        char mode = modes[i];
+        if(mode == '+' || mode == '-')
+        {
+            set = mode == '+';
+            continue;
+        }
+        int prefix = caps.findPrefixMode(mode);
+        if(prefix < 0)
+        {
+            // skip the parameters of the modes we don't keep
+            if(caps.modeTakesParam(mode, set))
+                param++;
+            continue;
+        }
+        unsigned int user = _findUser(message.param(param++));
+        unsigned char* memberModes = user != IRC_STATE_NONE ? members.find(user) : NULL;
+        if(!memberModes)
+            continue;
+        _touch(id);
+        if(set)
+            *memberModes |= (unsigned char)(1 << prefix);
+        else
+            *memberModes &= (unsigned char)~(1 << prefix);
+    }
+}
+
+bool IrcStateTracker::isOnChannel(const IrcStringView& channel, const IrcStringView& nick) const
+{
+    return getMemberModes(channel, nick) >= 0;
+}
+
+int IrcStateTracker::getMemberModes(const IrcStringView& channel, const IrcStringView& nick) const
+{
+    unsigned int id = _findChannel(channel);
+    Return_MinusOne_Unless(id != IRC_STATE_NONE);
+    unsigned int user = _findUser(nick);
+    Return_MinusOne_Unless(user != IRC_STATE_NONE);
+    const unsigned char* modes = _channels[id]->members.find(user);
+    return modes ? *modes : -1;
+}
+
+size_t IrcStateTracker::getChannelSize(const IrcStringView& channel) const
+{
+    unsigned int id = _findChannel(channel);
+    Return_Zero_Unless(id != IRC_STATE_NONE);
+    return _channels[id]->members.size();
+}
+
+bool IrcStateTracker::getChannelMembers(const IrcStringView& channel, std::vector<std::string>* nicks, const IrcServerCaps* caps/* = NULL*/) const
+{
+    unsigned int id = _findChannel(channel);
+    Return_False_Unless(id != IRC_STATE_NONE);
+    const OpenHashMap<unsigned char>& members = _channels[id]->members;
+    nicks->reserve(nicks->size() + members.size());
+    for(size_t slot = 0; slot < members.capacity(); slot++)
+    {
+        Unless(members.occupied(slot))
+            continue;
+        IrcStringView nick = _nick(members.keyAt(slot));
+        unsigned char modes = members.valueAt(slot);
+        nicks->push_back(std::string());
+        std::string& entry = nicks->back();
+        if(caps && modes)
+        {
+            // the lowest bit is the highest prefix
+            unsigned int prefix = 0;
+            while(!(modes & (1 << prefix)))
+                prefix++;
+            if(prefix < caps->getPrefixCount())
+                entry.push_back(caps->getPrefixChar(prefix));
+        }
+        entry.append(nick.data, nick.size);
+    }
+    return true;
+}
+
+size_t IrcStateTracker::getChannelCount(const IrcStringView& channel, const IrcServerCaps& caps) const
+{
+    size_t count = 0;
+    for(size_t id = 0; id < _channels.size(); id++)
+    {
+        const Channel* tracked = _channels[id];
+        if(tracked && caps.sharesChannelLimit(IrcStringView(tracked->name.data(), tracked->name.size()), channel))
+            count++;
+    }
+    return count;
+}
+
+void IrcStateTracker::snapshot(IrcStateSnapshot* out, const IrcServerCaps& caps)
+{
+    IrcStateSnapshot::Block* block = new IrcStateSnapshot::Block();
+    block->references = 1;
+    block->mapping = _mapping;
+    block->channels.reserve(_channelCount);
+    for(size_t id = 0; id < _channels.size(); id++)
+    {
+        Channel* channel = _channels[id];
+        if(!channel)
+            continue;
+        if(!channel->snapshot)
+        {
+            IrcChannelSnapshot* copy = new IrcChannelSnapshot(channel->name, _mapping);
+            const OpenHashMap<unsigned char>& members = channel->members;
+            copy->_members.resize(members.size());
+            size_t index = 0;
+            for(size_t slot = 0; slot < members.capacity(); slot++)
+            {
+                Unless(members.occupied(slot))
+                    continue;
+                unsigned int user = members.keyAt(slot);
+                IrcChannelSnapshot::Member& member = copy->_members[index++];
+                member.nick = _userNicks[user];
+                IrcInternPool::global().retain(member.nick);
+                member.modes = members.valueAt(slot);
+                member.hash = _mapping.hash(_nick(user));
+                member.prefix = 0;
+                for(unsigned int prefix = 0; prefix < caps.getPrefixCount(); prefix++)
+                {
+                    if(member.modes & (1 << prefix))
+                    {
+                        member.prefix = caps.getPrefixChar(prefix);
+                        break;
+                    }
+                }
+            }
+            copy->seal();
+            channel->snapshot = copy;
+        }
+        channel->snapshot->retain();
+        block->channels.push_back(channel->snapshot);
+    }
+    IrcStateSnapshot result;
+    result._block = block;
+    out->swap(result);
+    _changed = false;
+}
+
+bool IrcStateTracker::getUserChannels(const IrcStringView& nick, std::vector<std::string>* channels) const
+{
+    unsigned int id = _findUser(nick);
+    Return_False_Unless(id != IRC_STATE_NONE);
+    for(unsigned int channel = _nextChannel(id, 0); channel != IRC_STATE_NONE; channel = _nextChannel(id, channel + 1))
+        channels->push_back(_channels[channel]->name);
+    return true;
+}
+
+bool IrcStateTracker::getUserPrefix(const IrcStringView& nick, std::string* prefix) const
+{
+    unsigned int id = _findUser(nick);
+    Return_False_Unless(id != IRC_STATE_NONE);
+    IrcStringView known = _nick(id);
+    prefix->assign(known.data, known.size);
+    if(_userNames[id] != IRC_STRING_NONE && _userHosts[id] != IRC_STRING_NONE)
+    {
+        IrcStringView user = _strings.get(_userNames[id]);
+        IrcStringView host = _strings.get(_userHosts[id]);
+        prefix->append("!").append(user.data, user.size).append("@").append(host.data, host.size);
+    }
+    return true;
+}
+
+size_t IrcStateTracker::getUserMemoryUsage() const
+{
+    return _strings.getMemoryUsage()
+        + (_userNicks.capacity() + _userNames.capacity() + _userHosts.capacity() + _userNext.capacity()
+            + _freeUsers.capacity()) * sizeof(unsigned int)
+        + _userChannelCounts.capacity() * sizeof(unsigned short)
+        + _nicks.capacity() * (sizeof(unsigned int) * 2);
+}
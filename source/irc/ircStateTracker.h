@@ -0,0 +1,151 @@
+#ifndef _IRC_STATE_TRACKER_H_
+#define _IRC_STATE_TRACKER_H_
+#include <string>
+#include <vector>
+#include <util/util.h>
+#include <util/openHashMap.h>
+#include <irc/ircMessage.h>
+#include <irc/ircServerCaps.h>
+#include <irc/ircCaseMapping.h>
+#include <irc/ircStateSnapshot.h>
+#include <irc/ircStringTable.h>
+#include <irc/ircInternPool.h>
+
+//ircStateTracker.h
+//Author: Simon Wittenberg
+
+// Who is in the channels we are in and with which member modes, kept up to date from
+// JOIN, PART, KICK, QUIT, NICK, MODE and RPL_NAMREPLY (353) as they come in, so bots
+// can ask without a NAMES or WHOIS round trip.
+// Every nick and channel is stored once and known by a 32 bit id, memberships are only
+// ids. A channel maps its members' ids to their modes and a user only counts the channels
+// it is in, so a lookup is a hash and an array access and a QUIT or NICK looks the user
+// up in each of our channels, not at the 10000 others in them.
+// Users are no objects but an index into parallel arrays. Their nick is a symbol of
+// IrcInternPool, the same one snapshots hand out, the tracker holds a reference to it for
+// as long as it knows the user. Nicks are found by their hash under CASEMAPPING.
+// User name and host are ids in a string table of their own, which keeps each once no
+// matter how many share it.
+// source/bench/ircStateBench.cpp measures what a user costs.
+// Names are compared as the server's CASEMAPPING says, see setCaseMapping(...).
+// Not thread safe, IrcConnection guards it with its inner mutex.
+
+#define IRC_STATE_NONE ((unsigned int)-1)
+
+class IrcStateTracker
+{
+public:
+    IrcStateTracker();
+    ~IrcStateTracker();
+
+    // forgets everything, for a new session
+    void clear();
+
+    // how names compare, RFC 1459 unless set. Servers say before we join anything,
+    // what is tracked already is rehashed anyway
+    void setCaseMapping(const IrcCaseMapping& mapping);
+
+    // someone joined channel, if it is us we start to track it
+    void onJoin(const IrcStringView& channel, const IrcPrefix& who, bool self);
+    // nick left channel, by PART or KICK. If it is us we stop to track it
+    void onPart(const IrcStringView& channel, const IrcStringView& nick, bool self);
+    void onQuit(const IrcStringView& nick);
+    void onNick(const IrcStringView& nick, const IrcStringView& newNick);
+    // "@op +voiced nick!user@host ...", prefixed as PREFIX says, with multi-prefix and
+    // userhost-in-names as well
+    void onNames(const IrcStringView& channel, const IrcStringView& names, const IrcServerCaps& caps);
+    // "MODE #chan +ov-b nick nick mask", only member modes are kept
+    void onMode(const IrcMessageView& message, const IrcServerCaps& caps);
+
+    // whether we are in channel
+    bool isTracked(const IrcStringView& channel) const { return _findChannel(channel) != IRC_STATE_NONE; };
+    bool isOnChannel(const IrcStringView& channel, const IrcStringView& nick) const;
+    // the member modes of nick as bits in the order of PREFIX, bit 0 is the highest one.
+    // -1 if nick isn't in channel
+    int getMemberModes(const IrcStringView& channel, const IrcStringView& nick) const;
+    // 0 for channels we aren't in
+    size_t getChannelSize(const IrcStringView& channel) const;
+    // appends the nicks in channel, with their highest prefix in front if caps is given.
+    // Returns false for channels we aren't in
+    bool getChannelMembers(const IrcStringView& channel, std::vector<std::string>* nicks, const IrcServerCaps* caps = NULL) const;
+    // appends the channels we share with nick, returns false if we share none
+    bool getUserChannels(const IrcStringView& nick, std::vector<std::string>* channels) const;
+    // "nick!user@host" if we saw it, otherwise just the nick. Returns false for unknown nicks
+    bool getUserPrefix(const IrcStringView& nick, std::string* prefix) const;
+
+    size_t getUserCount() const { return _userCount; };
+    // bytes held for users and their names, without the members of channels and the text
+    // of nicks, that is in IrcInternPool::global()
+    size_t getUserMemoryUsage() const;
+    size_t getChannelCount() const { return _channelCount; };
+    // how many of the channels we are in count against the CHANLIMIT of channel
+    size_t getChannelCount(const IrcStringView& channel, const IrcServerCaps& caps) const;
+
+    // whether anything changed since the last snapshot(...)
+    bool hasChanged() const { return _changed; };
+    // a read only copy of all channels, only those that changed since the last call are
+    // copied again, see ircStateSnapshot.h
+    void snapshot(IrcStateSnapshot* out, const IrcServerCaps& caps);
+
+private:
+    struct Channel
+    {
+        std::string                 name;
+        // user id to member modes
+        OpenHashMap<unsigned char>  members;
+        // the last copy handed out, NULL once the channel changed
+        IrcChannelSnapshot*         snapshot;
+    };
+
+    unsigned int _findUser(const IrcStringView& nick) const;
+    unsigned int _findChannel(const IrcStringView& name) const;
+    unsigned int _addUser(const IrcStringView& nick);
+    unsigned int _addChannel(const IrcStringView& name);
+    void _dropUser(unsigned int id);
+    void _dropChannel(unsigned int id);
+    // frees the id of a user that is in no channel anymore
+    void _freeUser(unsigned int id);
+    // the channel changed, its snapshot is outdated
+    void _touch(unsigned int channel);
+    void _touchUser(unsigned int user);
+    void _addMember(unsigned int channel, unsigned int user, unsigned char modes);
+    // drops the user as well once it shares no channel with us anymore
+    void _removeMember(unsigned int channel, unsigned int user);
+    // adds nick!user@host to channel or updates it, returns the user's id
+    unsigned int _join(unsigned int channel, const IrcPrefix& who, unsigned char modes);
+    // replaces a user name or host, keeps what we have if name is empty
+    void _setName(unsigned int* id, const IrcStringView& name);
+
+    IrcStringView _nick(unsigned int user) const { return IrcInternPool::global().get(_userNicks[user]); };
+    // the next channel of user from channel on, IRC_STATE_NONE if there is none
+    unsigned int _nextChannel(unsigned int user, unsigned int channel) const;
+
+    // the hash of a name maps to the first user or channel with it, the others are
+    // chained through next
+    static void _link(OpenHashMap<unsigned int>& index, unsigned int hash, unsigned int id, std::vector<unsigned int>& next);
+    static void _unlink(OpenHashMap<unsigned int>& index, unsigned int hash, unsigned int id, std::vector<unsigned int>& next);
+
+    IrcCaseMapping              _mapping;
+    IrcStringTable              _strings;
+
+    // users by id, a nick of IRC_SYMBOL_NONE marks a free id
+    std::vector<IrcSymbol>      _userNicks;
+    std::vector<unsigned int>   _userNames;
+    std::vector<unsigned int>   _userHosts;
+    std::vector<unsigned int>   _userNext;
+    // how many of our channels a user is in, which ones the channels' members say
+    std::vector<unsigned short> _userChannelCounts;
+    std::vector<unsigned int>   _freeUsers;
+    OpenHashMap<unsigned int>   _nicks;
+    size_t                      _userCount;
+
+    std::vector<Channel*>       _channels;
+    std::vector<unsigned int>   _channelHashes;
+    std::vector<unsigned int>   _channelNext;
+    std::vector<unsigned int>   _freeChannels;
+    OpenHashMap<unsigned int>   _channelNames;
+    size_t                      _channelCount;
+    bool                        _changed;
+};
+
+#endif //_IRC_STATE_TRACKER_H_
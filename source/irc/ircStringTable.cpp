@@ -0,0 +1,125 @@
+#include "ircStringTable.h"
+#include <string.h>
+
+//ircStringTable.cpp
+//Author: Simon Wittenberg
+
+// don't bother compacting less than this
+#define IRC_STRING_TABLE_MIN_GARBAGE 4096
+
+
+unsigned int IrcStringTable::_hash(const IrcStringView& text)
+{
+    // FNV-1a, the strings are short
+    unsigned int hash = 2166136261u;
+    for(size_t i = 0; i < text.size; i++)
+    {
+        hash ^= (unsigned char)text.data[i];
+        hash *= 16777619u;
+    }
+    return hash == IRC_STRING_NONE ? hash - 1 : hash;
+}
+
+unsigned int IrcStringTable::find(const IrcStringView& text) const
+{
+    unsigned int hash = _hash(text);
+    const unsigned int* first = _index.find(hash);
+    for(unsigned int id = first ? *first : IRC_STRING_NONE; id != IRC_STRING_NONE; id = _entries[id].next)
+    {
+        const Entry& entry = _entries[id];
+        if(entry.length == text.size && (text.size == 0 || memcmp(&_bytes[entry.offset], text.data, text.size) == 0))
+            return id;
+    }
+    return IRC_STRING_NONE;
+}
+
+unsigned int IrcStringTable::intern(const IrcStringView& text)
+{
+    unsigned int id = find(text);
+    if(id != IRC_STRING_NONE)
+    {
+        _entries[id].references++;
+        return id;
+    }
+
+    if(_free.size())
+    {
+        id = _free.back();
+        _free.pop_back();
+    }
+    else
+    {
+        id = (unsigned int)_entries.size();
+        // grow by half, doubling leaves about as much unused as is in use
+        if(_entries.size() == _entries.capacity())
+            _entries.reserve(_entries.size() + _entries.size() / 2 + 1);
+        _entries.push_back(Entry());
+    }
+    if(_bytes.size() + text.size > _bytes.capacity())
+        _bytes.reserve(_bytes.size() + _bytes.size() / 2 + text.size);
+    Entry& entry = _entries[id];
+    entry.offset = (unsigned int)_bytes.size();
+    entry.length = (unsigned int)text.size;
+    entry.references = 1;
+    _bytes.insert(_bytes.end(), text.data, text.data + text.size);
+
+    unsigned int hash = _hash(text);
+    unsigned int* first = _index.find(hash);
+    entry.next = first ? *first : IRC_STRING_NONE;
+    _index.set(hash, id);
+    return id;
+}
+
+void IrcStringTable::release(unsigned int id)
+{
+    Entry& entry = _entries[id];
+    Return_Void_Unless(entry.references && --entry.references == 0);
+
+    unsigned int hash = _hash(get(id));
+    unsigned int* link = _index.find(hash);
+    if(*link == id)
+    {
+        if(entry.next == IRC_STRING_NONE)
+            _index.erase(hash);
+        else
+            *link = entry.next;
+    }
+    else
+    {
+        unsigned int other = *link;
+        while(_entries[other].next != id)
+            other = _entries[other].next;
+        _entries[other].next = entry.next;
+    }
+    _free.push_back(id);
+
+    _garbage += entry.length;
+    if(_garbage >= IRC_STRING_TABLE_MIN_GARBAGE && _garbage * 2 >= _bytes.size())
+        _compact();
+}
+
+void IrcStringTable::_compact()
+{
+    std::vector<char> bytes;
+    bytes.reserve((_bytes.size() - _garbage) * 3 / 2);
+    for(size_t id = 0; id < _entries.size(); id++)
+    {
+        Entry& entry = _entries[id];
+        if(!entry.references)
+            continue;
+        size_t offset = bytes.size();
+        bytes.insert(bytes.end(), _bytes.begin() + entry.offset, _bytes.begin() + entry.offset + entry.length);
+        entry.offset = (unsigned int)offset;
+    }
+    _bytes.swap(bytes);
+    _garbage = 0;
+}
+
+void IrcStringTable::clear()
+{
+    _bytes.clear();
+    _garbage = 0;
+    _entries.clear();
+    _free.clear();
+    _index.clear();
+}
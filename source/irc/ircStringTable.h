@@ -0,0 +1,73 @@
+#ifndef _IRC_STRING_TABLE_H_
+#define _IRC_STRING_TABLE_H_
+#include <vector>
+#include <util/util.h>
+#include <util/openHashMap.h>
+#include <irc/ircMessage.h>
+
+//ircStringTable.h
+//Author: Simon Wittenberg
+
+// Strings stored once and known by a 32 bit id, for tables that hold the same user names
+// and hosts many times over or refer to names by id anyway.
+// The text of all strings lives in one buffer, an entry is its offset and length, so a
+// string costs 16 bytes plus its text instead of a std::string with its own allocation.
+// Strings are reference counted. The text of released ones is left in the buffer until
+// it makes up half of it, then the buffer is compacted, ids stay the same.
+// Compares bytes as they are, not thread safe.
+
+#define IRC_STRING_NONE ((unsigned int)-1)
+
+class IrcStringTable
+{
+public:
+    IrcStringTable() : _garbage(0) {};
+
+    // the id of text with one more reference, text is added if it isn't in the table
+    unsigned int intern(const IrcStringView& text);
+    // the id of text, IRC_STRING_NONE if it isn't in the table
+    unsigned int find(const IrcStringView& text) const;
+    void retain(unsigned int id) { _entries[id].references++; };
+    // drops a reference, the string goes with the last one
+    void release(unsigned int id);
+
+    // the text of id, valid until the next intern(...) or release(...)
+    IrcStringView get(unsigned int id) const
+    {
+        const Entry& entry = _entries[id];
+        return IrcStringView(entry.length ? &_bytes[entry.offset] : "", entry.length);
+    };
+
+    // how many strings are in the table
+    size_t size() const { return _entries.size() - _free.size(); };
+    // bytes held by the table, without the index
+    size_t getMemoryUsage() const { return _bytes.capacity() + _entries.capacity() * sizeof(Entry) + _free.capacity() * sizeof(unsigned int); };
+
+    void clear();
+
+private:
+    struct Entry
+    {
+        unsigned int    offset;
+        unsigned int    length;
+        // 0 for free ids
+        unsigned int    references;
+        // the next entry with the same hash, see _index
+        unsigned int    next;
+    };
+
+    static unsigned int _hash(const IrcStringView& text);
+    // copies the text of all live entries to a new buffer
+    void _compact();
+
+    std::vector<char>           _bytes;
+    // bytes of released strings still in _bytes
+    size_t                      _garbage;
+    std::vector<Entry>          _entries;
+    std::vector<unsigned int>   _free;
+    // the hash of a string maps to the first entry with it, the others are chained
+    // through their next
+    OpenHashMap<unsigned int>   _index;
+};
+
+#endif //_IRC_STRING_TABLE_H_
@@ -0,0 +1,80 @@
+#ifndef _FD_SET_H_
+#define _FD_SET_H_
+
+//fdSet.h
+//Author: Simon Wittenberg
+
+// fd_set helpers that also work for descriptors beyond FD_SETSIZE.
+// libircclient only knows fd_set, which is limited to FD_SETSIZE descriptors.
+// A reactor easily exceeds that, so on linux we hand libircclient bitmaps that are
+// large enough for every descriptor the process may open. libircclient only ever
+// touches them through FD_SET/FD_ISSET and they are never passed to select(),
+// so this holds as long as libircclient isn't built with _FORTIFY_SOURCE.
+// Elsewhere these are plain fd_sets.
+
+#include <stdlib.h>
+#include <string.h>
+#include <util/threadHelper.h>
+
+#if defined (__linux__)
+    #include <sys/resource.h>
+
+#define IRC_FD_BITS_PER_WORD (8 * sizeof(unsigned long))
+
+static inline size_t irc_fd_capacity()
+{
+    struct rlimit limit;
+    size_t capacity = FD_SETSIZE;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur > capacity)
+        capacity = (size_t)limit.rlim_cur;
+    return capacity;
+}
+
+static inline fd_set* irc_fd_alloc(size_t capacity)
+{
+    size_t words = (capacity + IRC_FD_BITS_PER_WORD - 1) / IRC_FD_BITS_PER_WORD;
+    return (fd_set*) calloc(words, sizeof(unsigned long));
+}
+
+static inline void irc_fd_set(fd_set* set, int fd)
+{
+    ((unsigned long*)set)[fd / IRC_FD_BITS_PER_WORD] |= 1UL << (fd % IRC_FD_BITS_PER_WORD);
+}
+
+static inline void irc_fd_clear(fd_set* set, int fd)
+{
+    ((unsigned long*)set)[fd / IRC_FD_BITS_PER_WORD] &= ~(1UL << (fd % IRC_FD_BITS_PER_WORD));
+}
+
+static inline bool irc_fd_isset(fd_set* set, int fd)
+{
+    return (((unsigned long*)set)[fd / IRC_FD_BITS_PER_WORD] & (1UL << (fd % IRC_FD_BITS_PER_WORD))) != 0;
+}
+
+// clears every descriptor up to and including maxfd
+static inline void irc_fd_clear_upto(fd_set* set, int maxfd)
+{
+    if(maxfd >= 0)
+        memset(set, 0, (maxfd / IRC_FD_BITS_PER_WORD + 1) * sizeof(unsigned long));
+}
+
+#else
+
+static inline size_t irc_fd_capacity(){ return FD_SETSIZE; }
+
+static inline fd_set* irc_fd_alloc(size_t capacity)
+{
+    // calloc leaves it in the same state as FD_ZERO
+    return (fd_set*) calloc(1, sizeof(fd_set));
+}
+
+static inline void irc_fd_set(fd_set* set, int fd){ FD_SET(fd, set); }
+static inline void irc_fd_clear(fd_set* set, int fd){ FD_CLR(fd, set); }
+static inline bool irc_fd_isset(fd_set* set, int fd){ return FD_ISSET(fd, set) != 0; }
+static inline void irc_fd_clear_upto(fd_set* set, int maxfd){ for(int fd = 0; fd <= maxfd; fd++) FD_CLR(fd, set); }
+
+#endif
+
+static inline void irc_fd_free(fd_set* set){ free(set); }
+
+#endif //_FD_SET_H_
@@ -0,0 +1,157 @@
+#ifndef _OPEN_HASH_MAP_H_
+#define _OPEN_HASH_MAP_H_
+#include <stdlib.h>
+#include <string.h>
+#include <util/util.h>
+
+//openHashMap.h
+//Author: Simon Wittenberg
+
+// Hash map from 32 bit ids to small values with open addressing and linear probing.
+// Keys and values live in two flat arrays, a lookup touches one or two cache lines
+// instead of chasing the nodes of a std::map, which matters for tables with tens of
+// thousands of entries. The capacity is a power of two and kept at most 3/4 full.
+// Removing shifts the entries behind back, so there are no tombstones and lookups stay
+// short no matter how much was removed. Key OPEN_HASH_MAP_EMPTY can't be stored.
+// Value has to be plain old data, it lives in malloc()ed memory.
+
+#define OPEN_HASH_MAP_EMPTY ((unsigned int)-1)
+#define OPEN_HASH_MAP_MIN_CAPACITY 8
+
+template <class Value>
+class OpenHashMap
+{
+public:
+    OpenHashMap() : _keys(NULL), _values(NULL), _capacity(0), _size(0) {};
+    ~OpenHashMap() { free(_keys); free(_values); };
+
+    size_t size() const { return _size; };
+    bool empty() const { return _size == 0; };
+
+    // returns the value of key or NULL
+    Value* find(unsigned int key) const
+    {
+        Return_NULL_Unless(_size);
+        size_t mask = _capacity - 1;
+        for(size_t slot = _slot(key); _keys[slot] != OPEN_HASH_MAP_EMPTY; slot = (slot + 1) & mask)
+            if(_keys[slot] == key)
+                return &_values[slot];
+        return NULL;
+    };
+
+    // adds key or overwrites its value, returns false if we ran out of memory
+    bool set(unsigned int key, const Value& value)
+    {
+        Value* existing = find(key);
+        if(existing)
+        {
+            *existing = value;
+            return true;
+        }
+        if((_size + 1) * 4 > _capacity * 3)
+            Return_False_Unless(_resize(_capacity ? _capacity * 2 : OPEN_HASH_MAP_MIN_CAPACITY));
+        _insert(key, value);
+        _size++;
+        return true;
+    };
+
+    // returns false if key wasn't there
+    bool erase(unsigned int key)
+    {
+        Return_False_Unless(_size);
+        size_t mask = _capacity - 1;
+        size_t slot = _slot(key);
+        while(_keys[slot] != key)
+        {
+            Return_False_Unless(_keys[slot] != OPEN_HASH_MAP_EMPTY);
+            slot = (slot + 1) & mask;
+        }
+        // move every entry of the run behind the hole up, unless it already sits between
+        // its home slot and the hole
+        size_t hole = slot;
+        for(size_t next = (hole + 1) & mask; _keys[next] != OPEN_HASH_MAP_EMPTY; next = (next + 1) & mask)
+        {
+            size_t home = _slot(_keys[next]);
+            if(((next - home) & mask) >= ((next - hole) & mask))
+            {
+                _keys[hole] = _keys[next];
+                _values[hole] = _values[next];
+                hole = next;
+            }
+        }
+        _keys[hole] = OPEN_HASH_MAP_EMPTY;
+        _size--;
+        return true;
+    };
+
+    void clear()
+    {
+        free(_keys);
+        free(_values);
+        _keys = NULL;
+        _values = NULL;
+        _capacity = 0;
+        _size = 0;
+    };
+
+    // iteration, for(size_t i = 0; i < map.capacity(); i++) if(map.occupied(i)) ... map.keyAt(i)
+    size_t capacity() const { return _capacity; };
+    bool occupied(size_t slot) const { return _keys[slot] != OPEN_HASH_MAP_EMPTY; };
+    unsigned int keyAt(size_t slot) const { return _keys[slot]; };
+    Value& valueAt(size_t slot) const { return _values[slot]; };
+
+private:
+    // ids are mostly dense, so spread them before masking (Knuth's multiplicative hash)
+    size_t _slot(unsigned int key) const
+    {
+        unsigned int hash = key * 2654435761u;
+        return (size_t)(hash ^ (hash >> 16)) & (_capacity - 1);
+    };
+
+    void _insert(unsigned int key, const Value& value)
+    {
+        size_t mask = _capacity - 1;
+        size_t slot = _slot(key);
+        while(_keys[slot] != OPEN_HASH_MAP_EMPTY)
+            slot = (slot + 1) & mask;
+        _keys[slot] = key;
+        _values[slot] = value;
+    };
+
+    bool _resize(size_t capacity)
+    {
+        unsigned int* keys = (unsigned int*) malloc(capacity * sizeof(unsigned int));
+        Value* values = (Value*) malloc(capacity * sizeof(Value));
+        if(!keys || !values)
+        {
+            free(keys);
+            free(values);
+            return false;
+        }
+        memset(keys, 0xff, capacity * sizeof(unsigned int));
+
+        unsigned int* oldKeys = _keys;
+        Value* oldValues = _values;
+        size_t oldCapacity = _capacity;
+        _keys = keys;
+        _values = values;
+        _capacity = capacity;
+        for(size_t i = 0; i < oldCapacity; i++)
+            if(oldKeys[i] != OPEN_HASH_MAP_EMPTY)
+                _insert(oldKeys[i], oldValues[i]);
+        free(oldKeys);
+        free(oldValues);
+        return true;
+    };
+
+    // not copyable
+    OpenHashMap(const OpenHashMap&);
+    OpenHashMap& operator=(const OpenHashMap&);
+
+    unsigned int*   _keys;
+    Value*          _values;
+    size_t          _capacity;
+    size_t          _size;
+};
+
+#endif //_OPEN_HASH_MAP_H_
@@ -26,6 +26,31 @@
     #define DEFINE_MUTEX(x) IRC_MUTEX_HANDLE x = CreateMutex( NULL, FALSE, NULL );
     #define AQUIRE_MUTEX(x) WaitForSingleObject( x , INFINITE )
     #define RELEASE_MUTEX(x) ReleaseMutex( x )
+    #define INIT_MUTEX(x) x = CreateMutex( NULL, FALSE, NULL )
+    #define DESTROY_MUTEX(x) CloseHandle( x )
+
+    // joinable threads, used where the creator has to wait for the thread to finish
+    #define thread_handle_t    HANDLE
+    #define START_THREAD(handle,func,param)    ((handle = CreateThread(0, 0, func, param, 0, 0)) == 0)
+    #define JOIN_THREAD(handle)    { WaitForSingleObject( handle, INFINITE ); CloseHandle( handle ); }
+
+    // tells the thread a function is called on, e.g. to not wait for ourselfes
+    #define CURRENT_THREAD_ID()    GetCurrentThreadId()
+    #define SAME_THREAD(a,b)    ((a) == (b))
+    #define SLEEP_MILLISECONDS(a)    Sleep (a)
+
+    // reference counts shared between threads, both return the new value
+    #define irc_atomic_t    volatile LONG
+    #define ATOMIC_INCREMENT(x) InterlockedIncrement( &x )
+    #define ATOMIC_DECREMENT(x) InterlockedDecrement( &x )
+    // sets x to value if it is expected, returns what x was
+    #define ATOMIC_COMPARE_EXCHANGE(x,expected,value) InterlockedCompareExchange( &x, value, expected )
+
+    // pointers published by one thread and read by others without a lock, what was
+    // written to the object before the store is seen by whoever loads the pointer.
+    // Volatile reads and writes have acquire and release semantics with VC++
+    #define ATOMIC_LOAD_POINTER(x) (x)
+    #define ATOMIC_STORE_POINTER(x,value) InterlockedExchangePointer( (PVOID volatile*)&x, (PVOID)(value) )
 #else
     #include <unistd.h>
     #include <pthread.h>
@@ -40,6 +65,71 @@
 
     #define AQUIRE_MUTEX(x) pthread_mutex_lock( &x )
     #define RELEASE_MUTEX(x) pthread_mutex_unlock( &x )
+    #define INIT_MUTEX(x) pthread_mutex_init( &x, NULL )
+    #define DESTROY_MUTEX(x) pthread_mutex_destroy( &x )
+
+    // joinable threads, used where the creator has to wait for the thread to finish
+    #define thread_handle_t    pthread_t
+    #define START_THREAD(handle,func,param)    (pthread_create (&handle, 0, func, (void *) param) != 0)
+    #define JOIN_THREAD(handle)    pthread_join( handle, 0 )
+
+    // tells the thread a function is called on, e.g. to not wait for ourselfes
+    #define CURRENT_THREAD_ID()    pthread_self()
+    #define SAME_THREAD(a,b)    (pthread_equal( a, b ) != 0)
+    #define SLEEP_MILLISECONDS(a)    usleep ((a) * 1000)
+
+    // reference counts shared between threads, both return the new value
+    #define irc_atomic_t    volatile long
+    #define ATOMIC_INCREMENT(x) __sync_add_and_fetch( &x, 1 )
+    #define ATOMIC_DECREMENT(x) __sync_sub_and_fetch( &x, 1 )
+    // sets x to value if it is expected, returns what x was
+    #define ATOMIC_COMPARE_EXCHANGE(x,expected,value) __sync_val_compare_and_swap( &x, expected, value )
+
+    // pointers published by one thread and read by others without a lock, what was
+    // written to the object before the store is seen by whoever loads the pointer
+    #if defined (__ATOMIC_ACQUIRE)
+        #define ATOMIC_LOAD_POINTER(x) __atomic_load_n( &x, __ATOMIC_ACQUIRE )
+        #define ATOMIC_STORE_POINTER(x,value) __atomic_store_n( &x, value, __ATOMIC_RELEASE )
+    #else
+        #define ATOMIC_LOAD_POINTER(x) __sync_fetch_and_add( &x, 0 )
+        #define ATOMIC_STORE_POINTER(x,value) { __sync_synchronize(); x = value; __sync_synchronize(); }
+    #endif
+#endif // ifdef(WIN32)
+
+
+// monotonic clock in milliseconds, used for timers (reconnect delays, flood control, ...)
+typedef unsigned long long millis_t;
+
+#if defined (WIN32)
+    static inline millis_t getMilliseconds()
+    {
+        LARGE_INTEGER frequency, counter;
+        QueryPerformanceFrequency(&frequency);
+        QueryPerformanceCounter(&counter);
+        return (millis_t)(counter.QuadPart * 1000 / frequency.QuadPart);
+    }
+
+    static inline unsigned int getProcessorCount()
+    {
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+    }
+#else
+    #include <time.h>
+
+    static inline millis_t getMilliseconds()
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (millis_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    }
+
+    static inline unsigned int getProcessorCount()
+    {
+        long count = sysconf(_SC_NPROCESSORS_ONLN);
+        return count > 0 ? (unsigned int)count : 1;
+    }
 #endif // ifdef(WIN32)
 
 
@@ -71,6 +161,62 @@ private:
     IRC_MUTEX_HANDLE* _mutex;
 };
 
+// one thread waits until another one sets the event, set() before wait() is not lost
+class EventHandle
+{
+public:
+    EventHandle()
+    {
+#if defined (WIN32)
+        _event = CreateEvent( NULL, FALSE, FALSE, NULL );
+#else
+        pthread_mutex_init( &_mutex, NULL );
+        pthread_cond_init( &_condition, NULL );
+        _set = false;
+#endif
+    };
+    ~EventHandle()
+    {
+#if defined (WIN32)
+        CloseHandle( _event );
+#else
+        pthread_cond_destroy( &_condition );
+        pthread_mutex_destroy( &_mutex );
+#endif
+    };
+    void set()
+    {
+#if defined (WIN32)
+        SetEvent( _event );
+#else
+        pthread_mutex_lock( &_mutex );
+        _set = true;
+        pthread_cond_signal( &_condition );
+        pthread_mutex_unlock( &_mutex );
+#endif
+    };
+    void wait()
+    {
+#if defined (WIN32)
+        WaitForSingleObject( _event, INFINITE );
+#else
+        pthread_mutex_lock( &_mutex );
+        while(!_set)
+            pthread_cond_wait( &_condition, &_mutex );
+        _set = false;
+        pthread_mutex_unlock( &_mutex );
+#endif
+    };
+private:
+#if defined (WIN32)
+    HANDLE              _event;
+#else
+    pthread_mutex_t     _mutex;
+    pthread_cond_t      _condition;
+    bool                _set;
+#endif
+};
+
 
 
 #endif //_THREAD_HELPER_H_
\ No newline at end of file
@@ -0,0 +1,132 @@
+#ifndef _WAKEUP_CHANNEL_H_
+#define _WAKEUP_CHANNEL_H_
+
+//wakeupChannel.h
+//Author: Simon Wittenberg
+
+// A descriptor that can be added to select/epoll and signalled from any thread,
+// used to interrupt an event loop as soon as there is something to send instead
+// of waiting for its timeout.
+// eventfd on linux, a self-pipe on other posix systems and a connected loopback
+// udp socket on windows (winsock can only select on sockets).
+
+#include <string.h>
+#include <util/threadHelper.h>
+#include <util/util.h>
+
+#if defined (WIN32)
+    // winsock2.h is already included by threadHelper.h
+#elif defined (__linux__)
+    #include <sys/eventfd.h>
+    #include <fcntl.h>
+#else
+    #include <fcntl.h>
+#endif
+
+class WakeupChannel
+{
+public:
+    WakeupChannel()
+    {
+#if defined (WIN32)
+        _socket = socket(AF_INET, SOCK_DGRAM, 0);
+        struct sockaddr_in addr;
+        int len = sizeof(addr);
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        if(_socket == INVALID_SOCKET
+            || bind(_socket, (struct sockaddr*)&addr, sizeof(addr)) != 0
+            || getsockname(_socket, (struct sockaddr*)&addr, &len) != 0
+            || connect(_socket, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            if(_socket != INVALID_SOCKET)
+                closesocket(_socket);
+            _socket = INVALID_SOCKET;
+            return;
+        }
+        u_long nonBlocking = 1;
+        ioctlsocket(_socket, FIONBIO, &nonBlocking);
+#elif defined (__linux__)
+        _fds[0] = _fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+        if(pipe(_fds) != 0)
+        {
+            _fds[0] = _fds[1] = -1;
+            return;
+        }
+        fcntl(_fds[0], F_SETFL, fcntl(_fds[0], F_GETFL) | O_NONBLOCK);
+        fcntl(_fds[1], F_SETFL, fcntl(_fds[1], F_GETFL) | O_NONBLOCK);
+#endif
+    };
+
+    ~WakeupChannel()
+    {
+#if defined (WIN32)
+        if(_socket != INVALID_SOCKET)
+            closesocket(_socket);
+#else
+        if(_fds[0] >= 0)
+            close(_fds[0]);
+        if(_fds[1] >= 0 && _fds[1] != _fds[0])
+            close(_fds[1]);
+#endif
+    };
+
+    bool isValid(){ return getDescriptor() >= 0; };
+
+    // the descriptor to watch for readability
+    int getDescriptor()
+    {
+#if defined (WIN32)
+        return _socket == INVALID_SOCKET ? -1 : (int)_socket;
+#else
+        return _fds[0];
+#endif
+    };
+
+    // may be called from any thread
+    void signal()
+    {
+#if defined (WIN32)
+        send(_socket, "x", 1, 0);
+#elif defined (__linux__)
+        unsigned long long one = 1;
+        Return_Void_Unless(write(_fds[1], &one, sizeof(one)) == sizeof(one));
+#else
+        char byte = 'x';
+        Return_Void_Unless(write(_fds[1], &byte, 1) == 1);
+#endif
+    };
+
+    // called by the loop after the descriptor became readable
+    void drain()
+    {
+#if defined (WIN32)
+        char buf[64];
+        while(recv(_socket, buf, sizeof(buf), 0) > 0)
+            ;
+#elif defined (__linux__)
+        unsigned long long count;
+        Return_Void_Unless(read(_fds[0], &count, sizeof(count)) == sizeof(count));
+#else
+        char buf[64];
+        while(read(_fds[0], buf, sizeof(buf)) > 0)
+            ;
+#endif
+    };
+
+private:
+    // not copyable, the descriptors would be closed twice
+    WakeupChannel(const WakeupChannel&);
+    WakeupChannel& operator=(const WakeupChannel&);
+
+#if defined (WIN32)
+    SOCKET  _socket;
+#else
+    int     _fds[2];
+#endif
+};
+
+#endif //_WAKEUP_CHANNEL_H_